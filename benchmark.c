@@ -1,4 +1,5 @@
 #include "evhttpconn.h"
+#include "evhttpbuffer.h"
 
 #include <string.h>
 #include <stdio.h>
@@ -7,6 +8,7 @@
 #include <pthread.h>
 #include <getopt.h>
 #include <sys/time.h>
+#include <time.h>
 
 #include <pcre.h>
 
@@ -24,7 +26,10 @@ typedef struct
 {
     int code;
     int content_length;
-    int millis;
+    long micros; // from started
+    long started; // when it was meant to go, in micros
+    long sent; // when it went
+    long connect; // taken to open a connection for it, -1 if one was open
 } result_t;
 
 typedef struct
@@ -34,31 +39,87 @@ typedef struct
         int number;
         int concurrent;
         int threads;
+        int keep_alive;
+        int pipeline;
+        int pool;
+        int uring;
+        double rate; // over all threads, 0 to send as fast as replies come
+        const char *json; // files to write the results to as well
+        const char *csv;
         const char *url;
     } args;
 
     volatile int next_result_index;
     result_t *results;
+    long schedule_start; // in micros
 
     struct sockaddr_in serv_addr;
     evhttp_string_t request;
 } state_t;
 
+// Latencies in micros, in buckets that are exact below 128 and then
+// split each power of two into 64, so any value is within 1.6%
+#define HISTOGRAM_LINEAR 128
+#define HISTOGRAM_SUB 64
+#define HISTOGRAM_BUCKETS (HISTOGRAM_LINEAR + HISTOGRAM_SUB * 34)
+
+typedef struct
+{
+    long counts[HISTOGRAM_BUCKETS];
+    long total;
+    long sum;
+    long max;
+} histogram_t;
+
+// Where the time for a reply went: opening a connection for it, if
+// one was, then from the request being sent to the first byte back,
+// the rest of the first line, the headers and the body. With a
+// pipeline the wait includes the replies ahead in it.
+#define PHASE_CONNECT 0
+#define PHASE_WAIT 1
+#define PHASE_FIRST_LINE 2
+#define PHASE_HEADERS 3
+#define PHASE_BODY 4
+#define PHASES 5
+static const char *phase_names[PHASES] = { "connect", "wait", "first_line", "headers", "body" };
+
+typedef struct worker_info worker_info_t;
+
 typedef struct
 {
+    state_t *state;
+    worker_info_t *info;
     int fd;
     evhttp_connection_t http_conn;
     int running;
-    long started;
-    result_t *results;
+    long connect; // for the next request sent, -1 once used
 } connection_t;
 
-typedef struct
+struct worker_info
 {
     state_t *state;
+    int index;
     struct ev_loop *loop;
+    evhttp_pool_t pool;
+    evhttp_uring_t uring;
+    int has_uring;
+    ev_timer trim_watcher;
     connection_t *conns;
-} worker_info_t;
+
+    // with a rate, requests that are due but not yet sent
+    ev_timer rate_watcher;
+    long slot; // of this thread's in the schedule
+    long next_start;
+    int scheduled_all;
+    evhttp_buffer_t backlog;
+    int next_conn;
+
+    // of the replies, overall and for each second of the run
+    histogram_t latency;
+    histogram_t *series;
+    int series_length;
+    histogram_t phases[PHASES];
+};
 
 
 static long now()
@@ -68,26 +129,355 @@ static long now()
     return (tv.tv_sec * 1000) + (tv.tv_usec / 1000);
 }
 
+static long micros()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000L + ts.tv_nsec / 1000;
+}
+
+///
+// Histograms
+///
+
+static int histogram_bucket(long value)
+{
+    int shift;
+
+    if (value < HISTOGRAM_LINEAR)
+        return value > 0 ? value : 0;
+
+    // the top seven bits pick the bucket
+    shift = 63 - __builtin_clzl(value) - 6;
+    if (shift > (HISTOGRAM_BUCKETS - HISTOGRAM_LINEAR) / HISTOGRAM_SUB)
+        return HISTOGRAM_BUCKETS - 1;
+    return HISTOGRAM_LINEAR + (shift - 1) * HISTOGRAM_SUB + (int)(value >> shift) - HISTOGRAM_SUB;
+}
+
+// The highest value that falls in bucket
+static long histogram_value(int bucket)
+{
+    if (bucket < HISTOGRAM_LINEAR)
+        return bucket;
+
+    int shift = (bucket - HISTOGRAM_LINEAR) / HISTOGRAM_SUB + 1;
+    long sub = (bucket - HISTOGRAM_LINEAR) % HISTOGRAM_SUB + HISTOGRAM_SUB;
+    return ((sub + 1) << shift) - 1;
+}
+
+static void histogram_record(histogram_t *self, long value)
+{
+    ++self->counts[histogram_bucket(value)];
+    ++self->total;
+    self->sum += value;
+    if (value > self->max)
+        self->max = value;
+}
+
+static void histogram_merge(histogram_t *self, const histogram_t *other)
+{
+    int idx;
+    for (idx=0; idx<HISTOGRAM_BUCKETS; ++idx)
+        self->counts[idx] += other->counts[idx];
+    self->total += other->total;
+    self->sum += other->sum;
+    if (other->max > self->max)
+        self->max = other->max;
+}
+
+// The value below which percentile of them fall
+static long histogram_percentile(const histogram_t *self, double percentile)
+{
+    long wanted = (long)(self->total * percentile / 100. + 0.5);
+    long seen = 0;
+    int idx;
+
+    if (wanted < 1)
+        wanted = 1;
+    for (idx=0; idx<HISTOGRAM_BUCKETS; ++idx)
+    {
+        seen += self->counts[idx];
+        if (seen >= wanted)
+            break;
+    }
+    // never more than was seen
+    long value = histogram_value(idx);
+    return value < self->max ? value : self->max;
+}
+
+// The histogram for the second of the run that at falls in
+static histogram_t *series_at(histogram_t **series, int *length, int second)
+{
+    if (second < 0)
+        second = 0;
+    if (second >= *length)
+    {
+        histogram_t *grown = (histogram_t *)realloc(*series, sizeof(histogram_t) * (second + 1));
+        if (!grown)
+        {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+        memset(grown + *length, 0, sizeof(histogram_t) * (second + 1 - *length));
+        *series = grown;
+        *length = second + 1;
+    }
+    return *series + second;
+}
+
 static void on_first_line(evhttp_string_t first, evhttp_string_t second, evhttp_string_t third, void *data)
 {
     connection_t *conn = (connection_t *)data;
-    conn->results->code = strtol(second.data, NULL, 10);
+    result_t *result = (result_t *)evhttp_connection_request_data(&conn->http_conn);
+    if (result)
+        result->code = strtol(second.data, NULL, 10);
 }
 
 static void on_chunk(evhttp_string_t content, void *data)
 {
     connection_t *conn = (connection_t *)data;
-    conn->results->content_length += content.length;
+    result_t *result = (result_t *)evhttp_connection_request_data(&conn->http_conn);
+    if (result)
+        result->content_length += content.length;
+}
+
+static void send_request(connection_t *conn, result_t *result, long started)
+{
+    result->code = -2;
+    result->content_length = 0;
+    result->micros = 0;
+    result->started = started;
+    result->sent = micros();
+    result->connect = conn->connect;
+    conn->connect = -1;
+    evhttp_connection_send_request(&conn->http_conn, conn->state->request, result);
+}
+
+static void on_complete(void *data)
+{
+    connection_t *conn = (connection_t *)data;
+    state_t *state = conn->state;
+    result_t *result = (result_t *)evhttp_connection_request_data(&conn->http_conn);
+    int c;
+
+    if (result)
+    {
+        long finished = micros();
+        result->micros = finished - result->started;
+        histogram_record(&conn->info->latency, result->micros);
+        histogram_record(series_at(&conn->info->series, &conn->info->series_length, (finished - state->schedule_start) / 1000000), result->micros);
+
+        const evhttp_timing_t *timing = evhttp_connection_timing(&conn->http_conn);
+        long first_byte = (long)(timing->first_byte * 1e6);
+        long first_line = (long)(timing->first_line * 1e6);
+        long headers_end = (long)(timing->headers_end * 1e6);
+        histogram_t *phases = conn->info->phases;
+        if (result->connect >= 0)
+            histogram_record(phases + PHASE_CONNECT, result->connect);
+        histogram_record(phases + PHASE_WAIT, first_byte - result->sent);
+        histogram_record(phases + PHASE_FIRST_LINE, first_line - first_byte);
+        histogram_record(phases + PHASE_HEADERS, headers_end - first_line);
+        histogram_record(phases + PHASE_BODY, (long)(timing->complete * 1e6) - headers_end);
+    }
+
+    // what is due goes out from the rate watcher
+    if (state->args.rate > 0)
+    {
+        if (!state->args.keep_alive || !evhttp_connection_keep_alive(&conn->http_conn))
+            evhttp_connection_close(&conn->http_conn);
+        ev_feed_event(conn->info->loop, &conn->info->rate_watcher, EV_CUSTOM);
+        return;
+    }
+
+    if (state->args.keep_alive && evhttp_connection_keep_alive(&conn->http_conn))
+    {
+        // reuse the connection for the next request,
+        // keeping the pipeline full
+        c = __sync_fetch_and_add(&state->next_result_index, 1);
+        if (c < state->args.number)
+        {
+            send_request(conn, state->results + c, micros());
+            return;
+        }
+
+        // wait for the rest of the pipeline
+        if (evhttp_connection_in_flight(&conn->http_conn) > 1)
+            return;
+    }
+
+    evhttp_connection_close(&conn->http_conn);
 }
 
 static void on_close(void *data)
 {
     connection_t *conn = (connection_t *)data;
     conn->running = 0;
-    conn->results->millis = now() - conn->started;
     close(conn->fd);
+    if (conn->state->args.rate > 0)
+        ev_feed_event(conn->info->loop, &conn->info->rate_watcher, EV_CUSTOM);
+}
+
+static void on_trim(struct ev_loop *loop, ev_timer *watcher, int revents)
+{
+    evhttp_pool_trim((evhttp_pool_t *)watcher->data);
 }
 
+static int connection_open(worker_info_t *info, connection_t *conn)
+{
+    state_t *state = info->state;
+    long began = micros();
+
+    conn->fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (connect(conn->fd, (struct sockaddr *)&state->serv_addr, sizeof(state->serv_addr)) < 0)
+    {
+        close(conn->fd);
+        return -1;
+    }
+    conn->connect = micros() - began;
+
+    evhttp_connection_init_with_pool(&conn->http_conn,
+                                     info->loop,
+                                     state->args.pool ? &info->pool : NULL,
+                                     conn->fd,
+                                     on_first_line,
+                                     NULL,
+                                     NULL,
+                                     on_chunk,
+                                     NULL,
+                                     on_complete,
+                                     on_close,
+                                     (void *)conn);
+    evhttp_connection_set_timing(&conn->http_conn, 1);
+    if (info->has_uring)
+        evhttp_connection_use_uring(&conn->http_conn, &info->uring);
+    conn->running = 1;
+    return 0;
+}
+
+///
+// Open loop
+///
+
+// Send what is due on the connections that have room for it. When
+// none do it waits, and the wait counts towards its latency.
+static void dispatch(worker_info_t *info)
+{
+    state_t *state = info->state;
+    evhttp_buffer_t *backlog = &info->backlog;
+    int tries;
+
+    while (backlog->start < backlog->size)
+    {
+        connection_t *conn = NULL;
+        result_t *result;
+
+        for (tries=0; tries<state->args.concurrent && !conn; ++tries)
+        {
+            connection_t *next = info->conns + info->next_conn;
+            info->next_conn = (info->next_conn + 1) % state->args.concurrent;
+            if (!next->running || (state->args.keep_alive && evhttp_connection_in_flight(&next->http_conn) < state->args.pipeline))
+                conn = next;
+        }
+        if (!conn)
+            return;
+
+        memcpy(&result, backlog->data + backlog->start, sizeof(result));
+        backlog->start += sizeof(result);
+
+        if (!conn->running && connection_open(info, conn) != 0)
+        {
+            result->code = -1;
+            result->content_length = -1;
+            result->micros = 0;
+            printf("conn failed %i\n", (int)(conn - info->conns));
+            continue;
+        }
+        send_request(conn, result, result->started);
+    }
+
+    backlog->start = 0;
+    backlog->size = 0;
+}
+
+// Claim every request that is due by now, however late the loop is
+// in getting here, then wait for the next one to come due
+static void on_rate(struct ev_loop *loop, ev_timer *watcher, int revents)
+{
+    worker_info_t *info = (worker_info_t *)watcher->data;
+    state_t *state = info->state;
+    long now_micros = micros();
+
+    while (!info->scheduled_all && info->next_start <= now_micros)
+    {
+        int c = __sync_fetch_and_add(&state->next_result_index, 1);
+        if (c >= state->args.number)
+        {
+            info->scheduled_all = 1;
+            break;
+        }
+
+        result_t *result = state->results + c;
+        result->code = -2;
+        result->started = info->next_start;
+
+        evhttp_buffer_compact(&info->backlog);
+        if (evhttp_buffer_make_space(&info->backlog, sizeof(result)) != 0)
+        {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+        memcpy(info->backlog.data + info->backlog.size, &result, sizeof(result));
+        info->backlog.size += sizeof(result);
+
+        // the threads take turns through one schedule
+        ++info->slot;
+        info->next_start = state->schedule_start + (long)(((double)info->slot * state->args.threads + info->index) * 1e6 / state->args.rate);
+    }
+
+    dispatch(info);
+
+    ev_timer_stop(loop, watcher);
+    if (!info->scheduled_all)
+    {
+        long wait = info->next_start - micros();
+        ev_timer_set(watcher, wait > 0 ? wait / 1e6 : 0., 0.);
+        ev_timer_start(loop, watcher);
+    }
+}
+
+static void open_loop(worker_info_t *info)
+{
+    state_t *state = info->state;
+    int i, busy;
+
+    info->slot = 0;
+    info->next_start = state->schedule_start + (long)(info->index * 1e6 / state->args.rate);
+    on_rate(info->loop, &info->rate_watcher, EV_TIMER);
+
+    for (;;)
+    {
+        busy = !info->scheduled_all || info->backlog.start < info->backlog.size;
+        for (i=0; i<state->args.concurrent && !busy; ++i)
+            busy = info->conns[i].running && evhttp_connection_in_flight(&info->conns[i].http_conn) > 0;
+        if (!busy)
+            break;
+
+        ev_loop(info->loop, EVLOOP_ONESHOT);
+    }
+
+    // kept alive for more that never came
+    for (i=0; i<state->args.concurrent; ++i)
+    {
+        if (info->conns[i].running)
+            evhttp_connection_close(&info->conns[i].http_conn);
+    }
+    evhttp_buffer_free(&info->backlog);
+}
+
+///
+// Closed loop
+///
+
 static void *worker(worker_info_t *info)
 {
     int c = 0, i, j;
@@ -95,6 +485,12 @@ static void *worker(worker_info_t *info)
 
     state_t *state = info->state;
 
+    if (state->args.rate > 0)
+    {
+        open_loop(info);
+        return NULL;
+    }
+
     while (c<state->args.number)
     {
         for (i=0; i<state->args.concurrent; ++i)
@@ -105,37 +501,31 @@ static void *worker(worker_info_t *info)
                 if (c >= state->args.number)
                     break;
 
-                info->conns[i].started = now();
-                info->conns[i].fd = socket(AF_INET, SOCK_STREAM, 0);
-                if (connect(info->conns[i].fd, (struct sockaddr *)&state->serv_addr, sizeof(state->serv_addr)) < 0)
+                long started = micros();
+                if (connection_open(info, info->conns + i) != 0)
                 {
                     // connection failed
                     state->results[c].code = -1;
                     state->results[c].content_length = -1;
-                    state->results[c].millis = 0;
+                    state->results[c].micros = 0;
                     printf("conn failed %i\n", i);
-                    close(info->conns[i].fd);
                 }
                 else
                 {
-                    evhttp_connection_init(&info->conns[i].http_conn,
-                                           info->loop,
-                                           info->conns[i].fd,
-                                           on_first_line,
-                                           NULL,
-                                           NULL,
-                                           on_chunk,
-                                           NULL,
-                                           NULL,
-                                           on_close,
-                                           (void *)(info->conns + i));
-                    state->results[c].code = -2;
-                    state->results[c].content_length = 0;
-                    state->results[c].millis = 0;
-                    evhttp_connection_send(&info->conns[i].http_conn, state->request);
-                    info->conns[i].running = 1;
-                    info->conns[i].results = state->results + c;
+                    // the whole pipeline goes in one write
+                    evhttp_connection_begin_batch(&info->conns[i].http_conn);
+                    send_request(info->conns + i, state->results + c, started);
     done ++;
+
+                    // fill the pipeline
+                    for (j=1; j<state->args.pipeline; ++j)
+                    {
+                        c = __sync_fetch_and_add(&state->next_result_index, 1);
+                        if (c >= state->args.number)
+                            break;
+                        send_request(info->conns + i, state->results + c, started);
+                    }
+                    evhttp_connection_end_batch(&info->conns[i].http_conn);
                 }
             }
         }
@@ -163,6 +553,124 @@ static void *worker(worker_info_t *info)
 
         ev_loop(info->loop, EVLOOP_ONESHOT);
     }
+    return NULL;
+}
+
+///
+// Reports
+///
+
+static const double percentiles[] = { 50, 90, 99, 99.9 };
+#define PERCENTILES ((int)(sizeof(percentiles) / sizeof(percentiles[0])))
+
+static void report_percentiles(const histogram_t *histogram)
+{
+    int idx;
+
+    printf("  mean %.3f", histogram->sum / 1000. / histogram->total);
+    for (idx=0; idx<PERCENTILES; ++idx)
+        printf("  p%g %.3f", percentiles[idx], histogram_percentile(histogram, percentiles[idx]) / 1000.);
+    printf("  max %.3f\n", histogram->max / 1000.);
+}
+
+static void json_percentiles(FILE *out, const histogram_t *histogram)
+{
+    int idx;
+
+    fprintf(out, "{\"count\": %li, \"mean\": %.1f", histogram->total, histogram->total ? (double)histogram->sum / histogram->total : 0.);
+    for (idx=0; idx<PERCENTILES; ++idx)
+        fprintf(out, ", \"p%g\": %li", percentiles[idx], histogram->total ? histogram_percentile(histogram, percentiles[idx]) : 0);
+    fprintf(out, ", \"max\": %li}", histogram->max);
+}
+
+// Everything in micros, for tracking from one run to the next
+static int write_json(const char *path, state_t *state, long millis, int ok, int failed, int other,
+                      const histogram_t *latency, const histogram_t *lag, const histogram_t *phases,
+                      const histogram_t *series, int series_length)
+{
+    FILE *out = fopen(path, "w");
+    int idx;
+
+    if (!out)
+        return -1;
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"url\": \"%s\",\n", state->args.url);
+    fprintf(out, "  \"threads\": %i,\n", state->args.threads);
+    fprintf(out, "  \"concurrent\": %i,\n", state->args.concurrent);
+    fprintf(out, "  \"keep_alive\": %s,\n", state->args.keep_alive ? "true" : "false");
+    fprintf(out, "  \"pipeline\": %i,\n", state->args.pipeline);
+    fprintf(out, "  \"rate\": %g,\n", state->args.rate);
+    fprintf(out, "  \"requests\": %i,\n", state->args.number);
+    fprintf(out, "  \"ok\": %i,\n", ok);
+    fprintf(out, "  \"failed\": %i,\n", failed);
+    fprintf(out, "  \"other\": %i,\n", other);
+    fprintf(out, "  \"millis\": %li,\n", millis);
+    fprintf(out, "  \"rps\": %.1f,\n", millis ? 1000. * state->args.number / millis : 0.);
+    fprintf(out, "  \"latency_us\": ");
+    json_percentiles(out, latency);
+    if (lag->total)
+    {
+        fprintf(out, ",\n  \"behind_schedule_us\": ");
+        json_percentiles(out, lag);
+    }
+    fprintf(out, ",\n  \"phases_us\": {");
+    for (idx=0; idx<PHASES; ++idx)
+    {
+        fprintf(out, "%s\n    \"%s\": ", idx ? "," : "", phase_names[idx]);
+        json_percentiles(out, phases + idx);
+    }
+    fprintf(out, "\n  }");
+    fprintf(out, ",\n  \"series\": [");
+    for (idx=0; idx<series_length; ++idx)
+    {
+        fprintf(out, "%s\n    {\"second\": %i, \"latency_us\": ", idx ? "," : "", idx);
+        json_percentiles(out, series + idx);
+        fprintf(out, "}");
+    }
+    fprintf(out, "\n  ]\n}\n");
+    return fclose(out);
+}
+
+// A row per second, one for the whole run and one for each phase
+static int write_csv(const char *path, const histogram_t *latency, const histogram_t *phases,
+                     const histogram_t *series, int series_length)
+{
+    FILE *out = fopen(path, "w");
+    int idx, p;
+
+    if (!out)
+        return -1;
+
+    fprintf(out, "second,replies,mean_us");
+    for (p=0; p<PERCENTILES; ++p)
+        fprintf(out, ",p%g_us", percentiles[p]);
+    fprintf(out, ",max_us\n");
+
+    for (idx=0; idx<=series_length+PHASES; ++idx)
+    {
+        const histogram_t *histogram;
+        if (idx < series_length)
+        {
+            histogram = series + idx;
+            fprintf(out, "%i", idx);
+        }
+        else if (idx == series_length)
+        {
+            histogram = latency;
+            fprintf(out, "all");
+        }
+        else
+        {
+            histogram = phases + idx - series_length - 1;
+            fprintf(out, "%s", phase_names[idx - series_length - 1]);
+        }
+        fprintf(out, ",%li,%.1f", histogram->total, histogram->total ? (double)histogram->sum / histogram->total : 0.);
+        for (p=0; p<PERCENTILES; ++p)
+            fprintf(out, ",%li", histogram->total ? histogram_percentile(histogram, percentiles[p]) : 0);
+        fprintf(out, ",%li\n", histogram->max);
+    }
+    return fclose(out);
 }
 
 int main(int argc, char * const argv[])
@@ -176,14 +684,26 @@ int main(int argc, char * const argv[])
     state.args.number = 1;
     state.args.concurrent = 1;
     state.args.threads = 1;
+    state.args.keep_alive = 0;
+    state.args.pipeline = 1;
+    state.args.pool = 1;
+    state.args.uring = 0;
+    state.args.rate = 0;
+    state.args.json = NULL;
+    state.args.csv = NULL;
 
     state.next_result_index = 0;
 
     for (;;)
     {
-        static struct option long_options[] = { {0, 0, 0, 0} };
+        static struct option long_options[] =
+        {
+            {"json", required_argument, 0, 'J'},
+            {"csv", required_argument, 0, 'V'},
+            {0, 0, 0, 0}
+        };
 
-        c = getopt_long(argc, argv, "n:c:t:z",
+        c = getopt_long(argc, argv, "n:c:t:kp:zmuR:",
                         long_options, &option_index);
 
         if (c == -1)
@@ -200,9 +720,38 @@ int main(int argc, char * const argv[])
         case 't':
             state.args.threads = atoi(optarg);
             break;
+        case 'k':
+            state.args.keep_alive = 1;
+            break;
+        case 'p':
+            state.args.pipeline = atoi(optarg);
+            if (state.args.pipeline < 1)
+                state.args.pipeline = 1;
+            state.args.keep_alive = 1;
+            break;
         case 'z':
             use_deflate = 1;
             break;
+        case 'm':
+            // plain malloc rather than the buffer pool
+            state.args.pool = 0;
+            break;
+        case 'u':
+            // reads and writes through io_uring
+            state.args.uring = 1;
+            break;
+        case 'R':
+            // requests start on a fixed schedule rather than
+            // as replies come, so a slow server can not hold
+            // back the load and hide its queueing
+            state.args.rate = atof(optarg);
+            break;
+        case 'J':
+            state.args.json = optarg;
+            break;
+        case 'V':
+            state.args.csv = optarg;
+            break;
         default:
             usage();
             return 1;
@@ -264,12 +813,13 @@ int main(int argc, char * const argv[])
     char request[4096];
     int printed = snprintf(request,
                            4096,
-                           "GET %s HTTP/1.0\r\n"
+                           "GET %s HTTP/1.%i\r\n"
                            "Host: %s\r\n"
                            "User-Agent: benchmark\r\n"
                            "%s"
                            "Accept: */*\r\n\r\n",
                            path,
+                           state.args.keep_alive,
                            host_header,
                            use_deflate ? "accept-encoding: gzip,deflate\r\n" : ""
                            );
@@ -293,24 +843,45 @@ int main(int argc, char * const argv[])
     for (i=0; i<state.args.threads; ++i)
     {
         worker_infos[i].state = &state;
+        worker_infos[i].index = i;
         worker_infos[i].loop = ev_loop_new(0);
+        evhttp_pool_init(&worker_infos[i].pool);
+        worker_infos[i].trim_watcher.data = &worker_infos[i].pool;
+        ev_timer_init(&worker_infos[i].trim_watcher, on_trim, 1., 1.);
+        ev_timer_start(worker_infos[i].loop, &worker_infos[i].trim_watcher);
+        // the trim timer alone should not keep the loop going
+        ev_unref(worker_infos[i].loop);
+        worker_infos[i].has_uring = state.args.uring && evhttp_uring_init(&worker_infos[i].uring, worker_infos[i].loop) == 0;
+        worker_infos[i].rate_watcher.data = worker_infos + i;
+        ev_timer_init(&worker_infos[i].rate_watcher, on_rate, 0., 0.);
+        worker_infos[i].scheduled_all = 0;
+        worker_infos[i].next_conn = 0;
+        evhttp_buffer_init(&worker_infos[i].backlog);
+        memset(&worker_infos[i].latency, 0, sizeof(histogram_t));
+        worker_infos[i].series = NULL;
+        worker_infos[i].series_length = 0;
+        memset(worker_infos[i].phases, 0, sizeof(worker_infos[i].phases));
         worker_infos[i].conns = malloc(sizeof(connection_t) * state.args.concurrent);
         for (j=0; j<state.args.concurrent; ++j)
         {
             connection_t *conn = worker_infos[i].conns + j;
 
+            conn->state = &state;
+            conn->info = worker_infos + i;
             conn->fd = -1;
             conn->running = 0;
-            conn->started = 0;
-            conn->results = NULL;
+            conn->connect = -1;
         }
     }
 
     // run
     pthread_t threads[state.args.threads];
 
-    printf("Sending %i request(s) to  %s.\n%i thread(s)\n%i concurrent connection(s) per thread\n\n", state.args.number, state.args.url, state.args.threads, state.args.concurrent);
+    printf("Sending %i request(s) to  %s.\n%i thread(s)\n%i concurrent connection(s) per thread\n%s\n%i request(s) in flight per connection\n\n", state.args.number, state.args.url, state.args.threads, state.args.concurrent, state.args.keep_alive ? "keep alive" : "connection per request", state.args.pipeline);
+    if (state.args.rate > 0)
+        printf("%g request(s) a second on a fixed schedule\n\n", state.args.rate);
     long started = now();
+    state.schedule_start = micros();
 
     for (i=1; i<state.args.threads; ++i)
     {
@@ -326,10 +897,26 @@ int main(int argc, char * const argv[])
 
     long millis = now() - started;
 
-    // clean up
+    // clean up, merging what the threads saw
+    histogram_t *latency = (histogram_t *)calloc(1, sizeof(histogram_t));
+    histogram_t *phases = (histogram_t *)calloc(PHASES, sizeof(histogram_t));
+    histogram_t *series = NULL;
+    int series_length = 0;
     for (i=0; i<state.args.threads; ++i)
     {
+        histogram_merge(latency, &worker_infos[i].latency);
+        for (j=0; j<PHASES; ++j)
+            histogram_merge(phases + j, worker_infos[i].phases + j);
+        for (j=0; j<worker_infos[i].series_length; ++j)
+            histogram_merge(series_at(&series, &series_length, j), worker_infos[i].series + j);
+        free(worker_infos[i].series);
+
         free(worker_infos[i].conns);
+        ev_ref(worker_infos[i].loop);
+        ev_timer_stop(worker_infos[i].loop, &worker_infos[i].trim_watcher);
+        if (worker_infos[i].has_uring)
+            evhttp_uring_free(&worker_infos[i].uring);
+        evhttp_pool_free(&worker_infos[i].pool);
         ev_loop_destroy(worker_infos[i].loop);
     }
     free(worker_infos);
@@ -362,7 +949,60 @@ int main(int argc, char * const argv[])
     if (conn_ok)
         printf("%g average bytes per page\n", (double)content_length / (double)conn_ok);
 
+    // latency runs from when a request was meant to start, so with
+    // a rate the time spent waiting behind a slow server counts
+    histogram_t *lag = (histogram_t *)calloc(1, sizeof(histogram_t));
+    for (i=0; i<state.args.number && state.args.rate > 0; ++i)
+    {
+        if (state.results[i].code == 200)
+            histogram_record(lag, state.results[i].sent - state.results[i].started);
+    }
+
+    if (latency->total)
+    {
+        printf("\nlatency in ms%s\n", state.args.rate > 0 ? ", from the scheduled start" : "");
+        report_percentiles(latency);
+        if (lag->total)
+        {
+            printf("behind schedule in ms\n");
+            report_percentiles(lag);
+        }
+
+        printf("\nby phase in ms\n");
+        for (j=0; j<PHASES; ++j)
+        {
+            if (!phases[j].total)
+                continue;
+            printf("%-10s", phase_names[j]);
+            report_percentiles(phases + j);
+        }
+
+        printf("\nper second\n");
+        printf("%8s %10s %10s %10s %10s %10s %10s\n", "second", "replies", "p50", "p90", "p99", "p99.9", "max");
+        for (j=0; j<series_length; ++j)
+        {
+            histogram_t *second = series + j;
+            printf("%8i %10li %10.3f %10.3f %10.3f %10.3f %10.3f\n", j, second->total,
+                   histogram_percentile(second, 50) / 1000.,
+                   histogram_percentile(second, 90) / 1000.,
+                   histogram_percentile(second, 99) / 1000.,
+                   histogram_percentile(second, 99.9) / 1000.,
+                   second->max / 1000.);
+        }
+        printf("\n");
+    }
+
     printf("%g rps\n", 1000.0 * ((double)state.args.number) / ((double)millis));
+
+    if (state.args.json && write_json(state.args.json, &state, millis, conn_ok, conn_failed, conn_other, latency, lag, phases, series, series_length) != 0)
+        perror(state.args.json);
+    if (state.args.csv && write_csv(state.args.csv, latency, phases, series, series_length) != 0)
+        perror(state.args.csv);
+
+    free(latency);
+    free(lag);
+    free(phases);
+    free(series);
     free(state.results);
 
     return 0;
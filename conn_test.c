@@ -0,0 +1,225 @@
+#include "evhttpconn.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+// Runs connections over a socketpair through sends and closes that
+// the parser test does not get to
+
+typedef struct
+{
+    evhttp_connection_t *conn;
+    int released;
+    int closed; // times
+    int closed_inside; // before the callback closing returned
+    int stuck;
+} outcome_t;
+
+static void on_release(void *data)
+{
+    ++((outcome_t *)data)->released;
+}
+
+static void on_close(void *data)
+{
+    ++((outcome_t *)data)->closed;
+}
+
+static void on_complete_close(void *data)
+{
+    outcome_t *outcome = (outcome_t *)data;
+    evhttp_connection_close(outcome->conn);
+    outcome->closed_inside = outcome->closed;
+}
+
+static void on_stuck(struct ev_loop *loop, ev_timer *watcher, int revents)
+{
+    ((outcome_t *)watcher->data)->stuck = 1;
+}
+
+// A file of size bytes, already unlinked
+static int temp_file(int size)
+{
+    char name[] = "/tmp/conn_testXXXXXX";
+    char data[256];
+    int fd = mkstemp(name);
+    if (fd < 0)
+    {
+        perror("mkstemp");
+        exit(1);
+    }
+    unlink(name);
+
+    memset(data, 'x', sizeof(data));
+    while (size > 0)
+    {
+        int length = size < (int)sizeof(data) ? size : (int)sizeof(data);
+        if (write(fd, data, length) != length)
+        {
+            perror("write");
+            exit(1);
+        }
+        size -= length;
+    }
+    return fd;
+}
+
+// Send more of a file than it holds, asking for too much up front
+// and then having it cut short once the send is queued
+static int test_short_file(struct ev_loop *loop)
+{
+    evhttp_connection_t conn;
+    outcome_t outcome = { NULL, 0, 0, 0, 0 };
+    ev_timer stuck_watcher;
+    char got[256];
+    int fds[2], file, received = 0, failed = 0;
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+    {
+        perror("socketpair");
+        exit(1);
+    }
+    file = temp_file(100);
+
+    evhttp_connection_init(&conn, loop, fds[0], NULL, NULL, NULL, NULL, NULL, NULL, on_close, &outcome);
+
+    if (evhttp_connection_sendfile(&conn, file, 50, 100, on_release, &outcome) == 0)
+    {
+        printf("%-12s the send past the end was taken\n", "short file");
+        failed = 1;
+    }
+
+    if (evhttp_connection_sendfile(&conn, file, 0, 100, on_release, &outcome) != 0)
+    {
+        printf("%-12s the send of the whole file failed\n", "short file");
+        failed = 1;
+    }
+    if (ftruncate(file, 10) != 0)
+    {
+        perror("ftruncate");
+        exit(1);
+    }
+
+    // spinning on the file never gets to the close
+    stuck_watcher.data = &outcome;
+    ev_timer_init(&stuck_watcher, on_stuck, 1., 0.);
+    ev_timer_start(loop, &stuck_watcher);
+    while (!outcome.closed && !outcome.stuck)
+        ev_run(loop, EVRUN_ONCE);
+    ev_timer_stop(loop, &stuck_watcher);
+
+    if (!outcome.closed)
+    {
+        printf("%-12s the connection stayed open\n", "short file");
+        evhttp_connection_close(&conn);
+        failed = 1;
+    }
+    if (outcome.released != 1)
+    {
+        printf("%-12s released %i time(s)\n", "short file", outcome.released);
+        failed = 1;
+    }
+
+    close(fds[0]);
+    for (;;)
+    {
+        int length = read(fds[1], got, sizeof(got));
+        if (length <= 0)
+            break;
+        received += length;
+    }
+    if (received != 10)
+    {
+        printf("%-12s %i byte(s) arrived not 10\n", "short file", received);
+        failed = 1;
+    }
+
+    close(fds[1]);
+    close(file);
+    return failed;
+}
+
+// Close from on_complete for a body that the end of the stream
+// completes, which has to wait until the parser is done with it
+static int test_close_at_eof(struct ev_loop *loop, evhttp_uring_t *uring, const char *name)
+{
+    static const char reply[] = "HTTP/1.0 200 OK\r\n\r\nthe body runs until the close";
+    evhttp_connection_t conn;
+    outcome_t outcome = { &conn, 0, 0, 0, 0 };
+    ev_timer stuck_watcher;
+    int fds[2], failed = 0;
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+    {
+        perror("socketpair");
+        exit(1);
+    }
+
+    evhttp_connection_init(&conn, loop, fds[0], NULL, NULL, NULL, NULL, NULL, on_complete_close, on_close, &outcome);
+    if (uring && evhttp_connection_use_uring(&conn, uring) != 0)
+    {
+        printf("%-12s could not use the ring\n", name);
+        failed = 1;
+    }
+
+    if (write(fds[1], reply, sizeof(reply) - 1) != sizeof(reply) - 1)
+    {
+        perror("write");
+        exit(1);
+    }
+    close(fds[1]);
+
+    stuck_watcher.data = &outcome;
+    ev_timer_init(&stuck_watcher, on_stuck, 1., 0.);
+    ev_timer_start(loop, &stuck_watcher);
+    while (!outcome.closed && !outcome.stuck)
+        ev_run(loop, EVRUN_ONCE);
+    ev_timer_stop(loop, &stuck_watcher);
+
+    if (outcome.closed != 1)
+    {
+        printf("%-12s closed %i time(s)\n", name, outcome.closed);
+        if (!outcome.closed)
+            evhttp_connection_close(&conn);
+        failed = 1;
+    }
+    if (outcome.closed_inside)
+    {
+        printf("%-12s closed inside on_complete\n", name);
+        failed = 1;
+    }
+
+    close(fds[0]);
+    return failed;
+}
+
+int main(int argc, char * const argv[])
+{
+    struct ev_loop *loop = ev_loop_new(0);
+    evhttp_uring_t uring;
+    int failed = 0, differ;
+
+    differ = test_short_file(loop);
+    printf("%-12s %s\n", "short file", differ ? "FAILED" : "ok");
+    failed |= differ;
+
+    differ = test_close_at_eof(loop, NULL, "eof close");
+    printf("%-12s %s\n", "eof close", differ ? "FAILED" : "ok");
+    failed |= differ;
+
+    if (evhttp_uring_init(&uring, loop) == 0)
+    {
+        differ = test_close_at_eof(loop, &uring, "ring close");
+        printf("%-12s %s\n", "ring close", differ ? "FAILED" : "ok");
+        failed |= differ;
+        evhttp_uring_free(&uring);
+    }
+    else
+        printf("%-12s skipped, no io_uring\n", "ring close");
+
+    ev_loop_destroy(loop);
+    return failed;
+}
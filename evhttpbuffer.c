@@ -0,0 +1,98 @@
+#include "evhttpbuffer.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+typedef evhttp_buffer_t buffer_t;
+
+void evhttp_buffer_init(buffer_t *self)
+{
+    self->data = NULL;
+    self->start = 0;
+    self->size = 0;
+    self->allocated = 0;
+    self->pool = NULL;
+}
+
+void evhttp_buffer_use_pool(buffer_t *self, evhttp_pool_t *pool)
+{
+    self->pool = pool;
+}
+
+void evhttp_buffer_free(buffer_t *self)
+{
+    evhttp_pool_t *pool = self->pool;
+
+    if (pool && self->data)
+        evhttp_pool_put(pool, self->data, self->allocated);
+    else
+        free(self->data);
+
+    evhttp_buffer_init(self);
+    self->pool = pool;
+}
+
+int evhttp_buffer_allocate(buffer_t *self, int size)
+{
+    if (size == self->allocated)
+        return 0;
+
+    if (self->pool)
+    {
+        char *data = evhttp_pool_get(self->pool, &size);
+        if (!data)
+            return -1;
+
+        if (self->data)
+        {
+            // the bytes before start can still be in use, the
+            // parser keeps a message's head there until its end
+            int keep = self->size < size ? self->size : size;
+            if (keep > 0)
+                memcpy(data, self->data, keep);
+            evhttp_pool_put(self->pool, self->data, self->allocated);
+        }
+
+        self->data = data;
+        self->allocated = size;
+        return 0;
+    }
+
+    char *data = (char *)realloc(self->data, size);
+    if (!data)
+        return -1;
+
+    self->data = data;
+    self->allocated = size;
+    return 0;
+}
+
+int evhttp_buffer_make_space(buffer_t *self, int size)
+{
+    int64_t new_size;
+
+    // sizes are ints, so this is as big as a buffer gets
+    if (size > INT_MAX - self->size)
+        return -1;
+
+    new_size = self->allocated;
+    if (new_size < 4096)
+        new_size = 4096;
+
+    while (new_size - self->size < size)
+        new_size <<= 1;
+    if (new_size > INT_MAX)
+        new_size = INT_MAX;
+
+    return evhttp_buffer_allocate(self, new_size);
+}
+
+void evhttp_buffer_compact(buffer_t *self)
+{
+    int remaining = self->size - self->start;
+    if (remaining > 0 && self->start > 0)
+        memmove(self->data, self->data + self->start, remaining);
+    self->start = 0;
+    self->size = remaining;
+}
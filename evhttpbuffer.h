@@ -0,0 +1,15 @@
+// Growable byte buffers shared by the parser and connections,
+// data[start, size) is the part in use
+
+#include "evhttpparser.h"
+#include "evhttppool.h"
+
+void evhttp_buffer_init(evhttp_buffer_t *self);
+// Take memory from pool rather than malloc, before anything is allocated
+void evhttp_buffer_use_pool(evhttp_buffer_t *self, evhttp_pool_t *pool);
+void evhttp_buffer_free(evhttp_buffer_t *self);
+int evhttp_buffer_allocate(evhttp_buffer_t *self, int size);
+// Make sure there are at least size bytes free after data + size
+int evhttp_buffer_make_space(evhttp_buffer_t *self, int size);
+// Move the part in use down to the start of data
+void evhttp_buffer_compact(evhttp_buffer_t *self);
@@ -1,10 +1,20 @@
+#define _GNU_SOURCE
 #include "evhttpconn.h"
+#include "evhttpbuffer.h"
 
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
 #include <unistd.h>
 #include <stdio.h>
-#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+#include <poll.h>
 
 typedef evhttp_buffer_t buffer_t;
 typedef struct ev_loop ev_loop_t;
@@ -12,74 +22,67 @@ typedef struct ev_io ev_io_t;
 typedef evhttp_connection_t connection_t;
 
 ///
-// Buffers
+// Connections
 ///
 
-static void buffer_init(buffer_t *self)
-{
-    self->data = NULL;
-    self->start = 0;
-    self->size = 0;
-    self->allocated = 0;
-}
-
-static void buffer_free(buffer_t *self)
-{
-    free(self->data);
-    buffer_init(self);
-}
-
-static int buffer_allocate(buffer_t *self, int size)
-{
-    if (size == self->allocated)
-        return 0;
-
-    char *data = (char *)realloc(self->data, size);
-    if (!data)
-        return -1;
-
-    self->data = data;
-    self->allocated = size;
-    return 0;
-}
+#define CLOSE_OK 0
+#define CLOSE_DELAY 1
+#define CLOSE_REQESTED 2
 
-static int buffer_make_space(buffer_t *self, int size)
+// Read sizes adapt between these to the recent throughput
+#define READ_SIZE_MIN 4096
+#define READ_SIZE_MAX (256 * 1024)
+// Most to read in one go before letting other connections in
+#define READ_FAIR_LIMIT (1024 * 1024)
+// Most segments to hand to one writev
+#define WRITE_IOV_MAX 64
+// Files are queued in segments of at most this
+#define FILE_SEGMENT_MAX (1 << 30)
+// Copies go into blocks of this, header included, or one
+// big enough for a bigger copy
+#define WRITE_BLOCK_SIZE (16 * 1024)
+
+// Copied bytes go into a chain of blocks, each one freed
+// as soon as all that was put in it has been written
+typedef struct evhttp_write_block
 {
-    int new_size;
-
-    new_size = self->allocated;
-    if (new_size < 4096)
-        new_size = 4096;
+    struct evhttp_write_block *next;
+    int allocated;
+    int size;
+    int written;
+} block_t;
 
-    while (new_size - self->size < size)
-        new_size <<= 1;
+#define BLOCK_DATA(block) ((char *)((block) + 1))
 
-    return buffer_allocate(self, new_size);
-}
+#define SEGMENT_MEMORY 0 // the caller's memory
+#define SEGMENT_COPY 1 // copied into a block
+#define SEGMENT_FILE 2
+#define SEGMENT_PIPE 3 // a file with no offset, so spliced
 
-static int buffer_find_chr(buffer_t *self, char c)
+// An entry in the write queue
+typedef struct
 {
-    int i;
-    char *data = (char *)self->data;
-    for (i=self->start; i<self->size; ++i)
-    {
-        if (data[i] == c)
-            return i;
-    }
-    return -1;
-}
-
-
-///
-// Connections
-///
-
-#define CLOSE_OK 0
-#define CLOSE_DELAY 1
-#define CLOSE_REQESTED 2
+    int kind;
+    int length; // left to write
+    const char *data;
+    block_t *block;
+    int file;
+    off_t offset;
+    evhttp_connection_on_release on_release;
+    void *release_data;
+} segment_t;
 
 static void on_read(ev_loop_t *loop, ev_io_t *watcher, int revents);
 static void on_write(ev_loop_t *loop, ev_io_t *watcher, int revents);
+static void on_file_ready(ev_loop_t *loop, ev_io_t *watcher, int revents);
+static void on_timeout(evhttp_timer_t *timer);
+static void timers_touch(connection_t *self);
+static int can_write_now(connection_t *self);
+static int write_start(connection_t *self);
+static int written(connection_t *self, int sent);
+static void on_ring_read(void *data, char *buffer, int result);
+static int on_ring_gather(void *data, struct iovec *iov, int max);
+static void on_ring_written(void *data, int result);
 
 void evhttp_connection_init(evhttp_connection_t *self,
                             struct ev_loop *loop,
@@ -92,12 +95,70 @@ void evhttp_connection_init(evhttp_connection_t *self,
                             evhttp_connection_on_complete on_complete,
                             evhttp_connection_on_close on_close,
                             void *callback_data)
+{
+    evhttp_connection_init_with_pool(self,
+                                     loop,
+                                     NULL,
+                                     fd,
+                                     on_first_line,
+                                     on_header,
+                                     on_headers_end,
+                                     on_chunk,
+                                     on_complete_content,
+                                     on_complete,
+                                     on_close,
+                                     callback_data);
+}
+
+void evhttp_connection_init_with_pool(evhttp_connection_t *self,
+                                      struct ev_loop *loop,
+                                      evhttp_pool_t *pool,
+                                      int fd,
+                                      evhttp_connection_on_first_line on_first_line,
+                                      evhttp_connection_on_header on_header,
+                                      evhttp_connection_on_headers_end on_headers_end,
+                                      evhttp_connection_on_content on_chunk,
+                                      evhttp_connection_on_content on_complete_content,
+                                      evhttp_connection_on_complete on_complete,
+                                      evhttp_connection_on_close on_close,
+                                      void *callback_data)
 {
     self->loop = loop;
     self->fd = fd;
-
-    buffer_init(&self->read_buffer);
-    buffer_init(&self->write_buffer);
+    self->read_size = READ_SIZE_MIN;
+    self->read_paused = 0;
+
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    evhttp_parser_init(&self->parser,
+                       on_first_line,
+                       on_header,
+                       on_headers_end,
+                       on_chunk,
+                       on_complete_content,
+                       on_complete,
+                       callback_data);
+
+    self->write_head = NULL;
+    self->write_tail = NULL;
+    self->write_queued = 0;
+    self->write_low = 0;
+    self->write_high = 0;
+    self->write_blocked = 0;
+    self->batching = 0;
+    self->on_write_blocked = NULL;
+    self->on_write_drained = NULL;
+    evhttp_buffer_init(&self->write_queue);
+    evhttp_buffer_init(&self->requests);
+
+    self->pool = pool;
+    if (pool)
+    {
+        evhttp_buffer_use_pool(&self->parser.buffer, pool);
+        evhttp_buffer_use_pool(&self->write_queue, pool);
+        evhttp_buffer_use_pool(&self->requests, pool);
+    }
+    self->answered = 0;
 
     self->read_watcher.data = self;
     ev_io_init(&self->read_watcher, on_read, fd, EV_READ);
@@ -105,36 +166,152 @@ void evhttp_connection_init(evhttp_connection_t *self,
     self->write_watcher.data = self;
     ev_io_init(&self->write_watcher, on_write, fd, EV_WRITE);
 
-    self->state = 0;
-    self->content_length = -2;
+    self->file_watcher.data = self;
+    ev_init(&self->file_watcher, on_file_ready);
+
+    self->timers = NULL;
+    evhttp_timer_init(&self->timer, on_timeout);
+    self->uring = NULL;
+    self->uring_link = NULL;
+    self->timed_out = 0;
+
     self->terminating = 0;
     self->closing = CLOSE_OK;
 
-    self->on_first_line = on_first_line;
-    self->on_header = on_header;
-    self->on_headers_end = on_headers_end;
-    self->on_chunk = on_chunk;
-    self->on_complete_content = on_complete_content;
-    self->on_complete = on_complete;
     self->on_close = on_close;
     self->callback_data = callback_data;
-    
+
     ev_io_start(loop, &self->read_watcher);
 }
 
+static block_t *block_new(connection_t *self, int length)
+{
+    int size = WRITE_BLOCK_SIZE;
+    block_t *block;
+
+    if (size < length + (int)sizeof(block_t))
+        size = length + sizeof(block_t);
+
+    if (self->pool)
+        block = (block_t *)evhttp_pool_get(self->pool, &size);
+    else
+        block = (block_t *)malloc(size);
+    if (!block)
+        return NULL;
+
+    block->next = NULL;
+    block->allocated = size;
+    block->size = 0;
+    block->written = 0;
+
+    if (self->write_tail)
+        self->write_tail->next = block;
+    else
+        self->write_head = block;
+    self->write_tail = block;
+    return block;
+}
+
+static void block_put(evhttp_pool_t *pool, block_t *block)
+{
+    if (pool)
+        evhttp_pool_put(pool, (char *)block, block->allocated);
+    else
+        free(block);
+}
+
+// Free the blocks at the front of the chain that are all written
+static void blocks_free(connection_t *self, int all)
+{
+    while (self->write_head && (all || self->write_head->written == self->write_head->size))
+    {
+        block_t *block = self->write_head;
+        self->write_head = block->next;
+        block_put(self->pool, block);
+    }
+    if (!self->write_head)
+        self->write_tail = NULL;
+}
+
+// Hand back memory that will now never be written
+static void release_all(buffer_t *queue)
+{
+    int idx;
+    for (idx=queue->start; idx<queue->size; idx+=sizeof(segment_t))
+    {
+        segment_t *segment = (segment_t *)(queue->data + idx);
+        if (segment->on_release)
+            segment->on_release(segment->release_data);
+    }
+}
+
+// What a write through uring still in flight at the close can be
+// reading, kept until the write is over
+typedef struct
+{
+    evhttp_pool_t *pool;
+    block_t *blocks;
+    buffer_t write_queue;
+} leftovers_t;
+
+static void on_ring_done(void *data)
+{
+    leftovers_t *leftovers = (leftovers_t *)data;
+
+    while (leftovers->blocks)
+    {
+        block_t *block = leftovers->blocks;
+        leftovers->blocks = block->next;
+        block_put(leftovers->pool, block);
+    }
+    release_all(&leftovers->write_queue);
+    evhttp_buffer_free(&leftovers->write_queue);
+    free(leftovers);
+}
+
 void evhttp_connection_close(evhttp_connection_t *self)
 {
     if (self->closing != CLOSE_OK)
     {
         self->closing = CLOSE_REQESTED;
+        evhttp_parser_halt(&self->parser);
         return;
     }
 
     ev_io_stop(self->loop, &self->read_watcher);
     ev_io_stop(self->loop, &self->write_watcher);
+    ev_io_stop(self->loop, &self->file_watcher);
+    evhttp_timer_cancel(&self->timer);
+    if (self->uring_link)
+    {
+        leftovers_t *leftovers = NULL;
+        if (self->uring_link->writing == 2)
+        {
+            leftovers = (leftovers_t *)malloc(sizeof(leftovers_t));
+            if (leftovers)
+            {
+                leftovers->pool = self->pool;
+                leftovers->blocks = self->write_head;
+                leftovers->write_queue = self->write_queue;
+            }
+            // without somewhere to keep them the blocks are
+            // lost, rather than freed under the kernel
+            self->write_head = NULL;
+            self->write_tail = NULL;
+            evhttp_buffer_init(&self->write_queue);
+        }
+        evhttp_uring_detach(self->uring_link, leftovers ? on_ring_done : NULL, leftovers);
+        self->uring_link = NULL;
+    }
+
+    evhttp_parser_free(&self->parser);
+    evhttp_buffer_free(&self->requests);
+    blocks_free(self, 1);
 
-    buffer_free(&self->read_buffer);
-    buffer_free(&self->write_buffer);
+    buffer_t write_queue = self->write_queue;
+    evhttp_buffer_init(&self->write_queue);
+    release_all(&write_queue);
+    evhttp_buffer_free(&write_queue);
 
     if (self->on_close)
     {
@@ -144,296 +321,852 @@ void evhttp_connection_close(evhttp_connection_t *self)
     }
 }
 
+void evhttp_connection_set_on_header_id(evhttp_connection_t *self, evhttp_connection_on_header_id on_header_id)
+{
+    evhttp_parser_set_on_header_id(&self->parser, on_header_id);
+}
+
+void evhttp_connection_set_on_headers(evhttp_connection_t *self, evhttp_header_t *headers, int max_headers, evhttp_connection_on_headers on_headers)
+{
+    evhttp_parser_set_on_headers(&self->parser, headers, max_headers, on_headers);
+}
+
+void evhttp_connection_set_on_body_target(evhttp_connection_t *self, evhttp_connection_on_body_target on_body_target)
+{
+    evhttp_parser_set_on_body_target(&self->parser, on_body_target);
+}
+
+// Make room for count more segments on the write queue
+static int queue_make_space(connection_t *self, int count)
+{
+    buffer_t *queue = &self->write_queue;
+
+    // only move the queue down when that costs
+    // no more than what has been written
+    if (queue->start > 0 && queue->start >= queue->size - queue->start)
+        evhttp_buffer_compact(queue);
+
+    return evhttp_buffer_make_space(queue, count * sizeof(segment_t));
+}
+
+static segment_t *queue_push(connection_t *self, int kind, const char *data, int length, evhttp_connection_on_release on_release, void *release_data)
+{
+    segment_t *segment = (segment_t *)(self->write_queue.data + self->write_queue.size);
+    segment->kind = kind;
+    segment->data = data;
+    segment->length = length;
+    segment->block = NULL;
+    segment->file = -1;
+    segment->on_release = on_release;
+    segment->release_data = release_data;
+    self->write_queue.size += sizeof(segment_t);
+    return segment;
+}
+
+// More is queued, so start it on its way and tell the producer if
+// it should hold off. This comes last in the send functions as both
+// can call back and close.
+static void queue_grew(connection_t *self, off_t length)
+{
+    // the write timeout runs from when there is something to write
+    if (self->write_queued == 0 && self->timers)
+    {
+        self->write_at = ev_now(self->loop);
+        self->write_queued = length;
+        timers_touch(self);
+    }
+    else
+        self->write_queued += length;
+
+    if (write_start(self) != 0)
+        return;
+
+    if (!self->write_blocked && self->write_high > 0 && self->write_queued >= self->write_high)
+    {
+        self->write_blocked = 1;
+        if (self->on_write_blocked)
+            self->on_write_blocked(self->callback_data);
+    }
+}
+
+char *evhttp_connection_make_send_buffer(evhttp_connection_t *self, int length)
+{
+    block_t *block = self->write_tail;
+
+    // room for the segment as well so the commit can not fail
+    if (queue_make_space(self, 1) != 0)
+        return NULL;
+
+    if (!block || block->allocated - (int)sizeof(block_t) - block->size < length)
+    {
+        block = block_new(self, length);
+        if (!block)
+            return NULL;
+    }
+
+    return BLOCK_DATA(block) + block->size;
+}
+
+void evhttp_connection_commit_send_buffer(evhttp_connection_t *self, int length)
+{
+    buffer_t *queue = &self->write_queue;
+    block_t *block = self->write_tail;
+    char *end = BLOCK_DATA(block) + block->size;
+    segment_t *last = NULL;
+
+    // an empty segment could outlive its block
+    if (length == 0)
+        return;
+
+    if (queue->start < queue->size)
+        last = (segment_t *)(queue->data + queue->size - sizeof(segment_t));
+
+    // follow on from the last copy if it is still at the end
+    if (!last || last->kind != SEGMENT_COPY || last->data + last->length != end)
+    {
+        last = queue_push(self, SEGMENT_COPY, end, 0, NULL, NULL);
+        last->block = block;
+    }
+
+    block->size += length;
+    last->length += length;
+    queue_grew(self, length);
+}
+
+// As evhttp_connection_send, with sent set to how much went straight
+// to the socket so a failure can tell if any of it is on the wire
+static int send_copy(connection_t *self, evhttp_string_t data, int *sent)
+{
+    char *buffer;
+
+    // with nothing ahead of it try the socket first,
+    // so only what it will not take is copied
+    *sent = 0;
+    if (self->write_queue.start == self->write_queue.size && can_write_now(self))
+    {
+        int got = write(self->fd, data.data, data.length);
+        if (got > 0)
+        {
+            *sent = got;
+            data.data += got;
+            data.length -= got;
+            if (self->timers)
+                self->write_at = ev_now(self->loop);
+        }
+        if (data.length == 0)
+            return 0;
+    }
+
+    buffer = evhttp_connection_make_send_buffer(self, data.length);
+    if (!buffer)
+        return -1;
+
+    memcpy(buffer, data.data, data.length);
+    evhttp_connection_commit_send_buffer(self, data.length);
+    return 0;
+}
+
 int evhttp_connection_send(evhttp_connection_t *self, evhttp_string_t data)
 {
-    if (buffer_make_space(&self->write_buffer, data.length) != 0)
+    int sent;
+    return send_copy(self, data, &sent);
+}
+
+int evhttp_connection_send_ref(evhttp_connection_t *self, evhttp_string_t data, evhttp_connection_on_release on_release, void *release_data)
+{
+    if (queue_make_space(self, 1) != 0)
         return -1;
 
-    memcpy(self->write_buffer.data + self->write_buffer.size, data.data, data.length);
-    self->write_buffer.size += data.length;
-    ev_io_start(self->loop, &self->write_watcher);
+    queue_push(self, SEGMENT_MEMORY, data.data, data.length, on_release, release_data);
+    queue_grew(self, data.length);
+    return 0;
+}
+
+int evhttp_connection_sendv(evhttp_connection_t *self, const struct iovec *iov, int count, evhttp_connection_on_release on_release, void *release_data)
+{
+    int idx;
+    off_t length = 0;
+
+    if (count <= 0)
+        return -1;
+
+    // a segment holds an int length
+    for (idx=0; idx<count; ++idx)
+    {
+        if (iov[idx].iov_len > INT_MAX)
+            return -1;
+    }
+
+    if (queue_make_space(self, count) != 0)
+        return -1;
+
+    // released together once the last one is written
+    for (idx=0; idx<count; ++idx)
+    {
+        int last = idx == count - 1;
+        queue_push(self, SEGMENT_MEMORY, (const char *)iov[idx].iov_base, iov[idx].iov_len,
+                   last ? on_release : NULL, last ? release_data : NULL);
+        length += iov[idx].iov_len;
+    }
+
+    queue_grew(self, length);
+    return 0;
+}
+
+int evhttp_connection_sendfile(evhttp_connection_t *self, int file_fd, off_t offset, off_t length, evhttp_connection_on_release on_release, void *release_data)
+{
+    struct stat info;
+    int count = (length + FILE_SEGMENT_MAX - 1) / FILE_SEGMENT_MAX;
+    off_t total = length;
+
+    if (length <= 0 || fstat(file_fd, &info) != 0 || queue_make_space(self, count) != 0)
+        return -1;
+    // one cut short after this is caught in send_file
+    if (S_ISREG(info.st_mode) && offset + length > info.st_size)
+        return -1;
+
+    // released once the last piece is written
+    while (length > 0)
+    {
+        int piece = length > FILE_SEGMENT_MAX ? FILE_SEGMENT_MAX : length;
+        length -= piece;
+        segment_t *segment = queue_push(self, S_ISFIFO(info.st_mode) ? SEGMENT_PIPE : SEGMENT_FILE, NULL, piece,
+                                        length ? NULL : on_release, length ? NULL : release_data);
+        segment->file = file_fd;
+        segment->offset = offset;
+        offset += piece;
+    }
+
+    queue_grew(self, total);
+    return 0;
+}
+
+void evhttp_connection_set_write_watermarks(evhttp_connection_t *self,
+                                            off_t low,
+                                            off_t high,
+                                            evhttp_connection_on_write on_write_blocked,
+                                            evhttp_connection_on_write on_write_drained)
+{
+    self->write_low = low;
+    self->write_high = high;
+    self->on_write_blocked = on_write_blocked;
+    self->on_write_drained = on_write_drained;
+}
+
+off_t evhttp_connection_write_queued(evhttp_connection_t *self)
+{
+    return self->write_queued;
+}
+
+void evhttp_connection_begin_batch(evhttp_connection_t *self)
+{
+    ++self->batching;
+}
+
+void evhttp_connection_end_batch(evhttp_connection_t *self)
+{
+    if (--self->batching == 0 && self->write_queue.start < self->write_queue.size)
+        write_start(self);
+}
+
+// Drop the requests for messages the parser has finished with
+static void answered(connection_t *self)
+{
+    int messages = evhttp_parser_messages(&self->parser);
+    while (self->answered != messages && self->requests.start < self->requests.size)
+    {
+        self->requests.start += sizeof(void *);
+        ++self->answered;
+    }
+    self->answered = messages;
+
+    if (self->requests.start == self->requests.size)
+    {
+        self->requests.start = 0;
+        self->requests.size = 0;
+        // pooled memory is cheap to get back
+        if (self->pool)
+            evhttp_buffer_free(&self->requests);
+    }
+}
+
+int evhttp_connection_send_request(evhttp_connection_t *self, evhttp_string_t data, void *request_data)
+{
+    int sent;
+
+    answered(self);
+    evhttp_buffer_compact(&self->requests);
+    if (evhttp_buffer_make_space(&self->requests, sizeof(void *)) != 0)
+        return -1;
+
+    // queued first, as sending can call back and close
+    memcpy(self->requests.data + self->requests.size, &request_data, sizeof(void *));
+    self->requests.size += sizeof(void *);
+
+    if (send_copy(self, data, &sent) != 0)
+    {
+        // with none of it sent there is no reply to wait for,
+        // a failure is before anything that could close
+        if (sent == 0)
+            self->requests.size -= sizeof(void *);
+        return -1;
+    }
     return 0;
 }
 
 void evhttp_connection_terminate(evhttp_connection_t *self)
 {
     self->terminating = 1;
-    if (self->write_buffer.start == self->write_buffer.size)
+    if (self->write_queue.start == self->write_queue.size)
         evhttp_connection_close(self);
 }
 
+int evhttp_connection_keep_alive(evhttp_connection_t *self)
+{
+    return evhttp_parser_keep_alive(&self->parser);
+}
+
+void *evhttp_connection_request_data(evhttp_connection_t *self)
+{
+    void *request_data = NULL;
+    answered(self);
+    if (self->requests.start < self->requests.size)
+        memcpy(&request_data, self->requests.data + self->requests.start, sizeof(void *));
+    return request_data;
+}
+
+int evhttp_connection_in_flight(evhttp_connection_t *self)
+{
+    answered(self);
+    return (self->requests.size - self->requests.start) / sizeof(void *);
+}
+
+void evhttp_connection_pause_read(evhttp_connection_t *self)
+{
+    self->read_paused = 1;
+    evhttp_parser_pause(&self->parser);
+    ev_io_stop(self->loop, &self->read_watcher);
+    if (self->uring_link)
+        evhttp_uring_read_stop(self->uring_link);
+    timers_touch(self);
+}
+
+void evhttp_connection_resume_read(evhttp_connection_t *self)
+{
+    if (!self->read_paused)
+        return;
+
+    // what was held back is parsed from the read callback,
+    // not from inside whatever callback is calling this
+    self->read_paused = 0;
+    self->read_at = ev_now(self->loop);
+    if (!self->uring_link || !self->uring->multishot)
+        ev_io_start(self->loop, &self->read_watcher);
+    ev_feed_event(self->loop, &self->read_watcher, EV_CUSTOM);
+}
+
+void evhttp_connection_set_max_body(evhttp_connection_t *self, int64_t max_body)
+{
+    evhttp_parser_set_max_body(&self->parser, max_body);
+}
+
+void evhttp_connection_set_timing(evhttp_connection_t *self, int timing)
+{
+    evhttp_parser_set_timing(&self->parser, timing);
+}
+
+const evhttp_timing_t *evhttp_connection_timing(evhttp_connection_t *self)
+{
+    return evhttp_parser_timing(&self->parser);
+}
+
+///
+// Timeouts
+///
+
+void evhttp_connection_use_timers(evhttp_connection_t *self, evhttp_timers_t *timers)
+{
+    self->timers = timers;
+    self->read_at = ev_now(self->loop);
+    self->write_at = self->read_at;
+    self->head_messages = -1;
+    timers_touch(self);
+}
+
+int evhttp_connection_timed_out(evhttp_connection_t *self)
+{
+    return self->timed_out;
+}
+
+void on_timeout(evhttp_timer_t *timer)
+{
+    connection_t *self = (connection_t *)((char *)timer - offsetof(connection_t, timer));
+    self->timed_out = 1;
+    evhttp_connection_close(self);
+}
+
+// Move the one timer to the earliest deadline that applies now,
+// cheap enough to do after every read and write
+static void timers_touch(connection_t *self)
+{
+    evhttp_timers_t *timers = self->timers;
+    ev_tstamp now, deadline = 0;
+    int phase;
+
+    if (!timers)
+        return;
+
+    now = ev_now(self->loop);
+    phase = evhttp_parser_phase(&self->parser);
+
+    // a new message starts the header clock, a message
+    // that is still in its head keeps the old one
+    if (phase != EVHTTP_PARSER_HEAD)
+        self->head_messages = -1;
+    else if (self->head_messages != evhttp_parser_messages(&self->parser))
+    {
+        self->head_at = now;
+        self->head_messages = evhttp_parser_messages(&self->parser);
+    }
+
+    // nothing is being read while paused, so nothing is late
+    if (!self->read_paused)
+    {
+        if (phase == EVHTTP_PARSER_HEAD && timers->header_timeout > 0)
+            deadline = self->head_at + timers->header_timeout;
+        else if (phase == EVHTTP_PARSER_BODY && timers->body_timeout > 0)
+            deadline = self->read_at + timers->body_timeout;
+        else if (phase == EVHTTP_PARSER_IDLE && timers->idle_timeout > 0)
+            deadline = (self->read_at > self->write_at ? self->read_at : self->write_at) + timers->idle_timeout;
+    }
+
+    if (self->write_queued > 0 && timers->write_timeout > 0)
+    {
+        ev_tstamp write_deadline = self->write_at + timers->write_timeout;
+        if (!deadline || write_deadline < deadline)
+            deadline = write_deadline;
+    }
+
+    if (deadline)
+        evhttp_timer_set(timers, &self->timer, deadline > now ? deadline - now : 0);
+    else
+        evhttp_timer_cancel(&self->timer);
+}
+
 void on_read(ev_loop_t *loop, ev_io_t *watcher, int revents)
 {
     connection_t *self = (connection_t *)watcher->data;
-    int got;
+    char *space, *target;
+    int64_t target_left;
+    int got, want, total = 0;
 
+    // the replies to everything read go out together
     self->closing = CLOSE_DELAY;
+    ++self->batching;
 
-    if (buffer_make_space(&self->read_buffer, 4096) != 0)
+    if (revents & EV_CUSTOM)
     {
-        goto close;
-    }
+        if (evhttp_parser_paused(&self->parser) && evhttp_parser_resume(&self->parser) != 0)
+            goto close;
 
-    got = read(self->fd, self->read_buffer.data + self->read_buffer.size, 4096);
-    if (got <= 0)
-    {
-        if (self->state == 4)
+        // the ring does the reading from here on
+        if (self->uring_link && self->uring->multishot)
         {
-            if (self->on_complete)
-                self->on_complete(self->callback_data);
+            if (!self->read_paused)
+                evhttp_uring_read_start(self->uring_link);
+            self->closing = CLOSE_OK;
+            timers_touch(self);
+            evhttp_connection_end_batch(self);
+            return;
         }
-        goto close;
     }
-    self->read_buffer.size += got;
 
-    if (self->state == 0)
+    // read until the socket is empty, or until this
+    // connection has had its fair share of the loop,
+    // when paused the rest is left in the socket so
+    // the sender is held back
+    while (total < READ_FAIR_LIMIT && !evhttp_parser_paused(&self->parser))
     {
-        int idx = buffer_find_chr(&self->read_buffer, ' ');
-        if (idx >= 0)
+        // a body with a target of its own is read straight into it,
+        // stopping at its end so the next message stays separate
+        want = self->read_size;
+        target = evhttp_parser_target_space(&self->parser, &target_left);
+        if (target)
         {
-            self->tmp[0] = self->read_buffer.start;
-            self->tmp[1] = idx - self->read_buffer.start;
-            self->read_buffer.start = idx + 1;
-            self->state = 1;
-
-            // if the message starts with HTTP then it is a
-            // reply, so handle unspecified content-length
-            self->content_length = -1;
+            space = target;
+            want = target_left < READ_FAIR_LIMIT ? target_left : READ_FAIR_LIMIT;
+        }
+        // with a pool read into the loop's scratch buffer and parse
+        // it there, so an idle connection holds on to no memory
+        else if (self->pool)
+            space = evhttp_pool_scratch(self->pool, READ_SIZE_MAX);
+        else
+            space = evhttp_parser_reserve(&self->parser, self->read_size);
+        if (!space)
+        {
+            goto close;
         }
-    }
 
-    if (self->state == 1)
-    {
-        int idx = buffer_find_chr(&self->read_buffer, ' ');
-        if (idx >= 0)
+        got = read(self->fd, space, want);
+        if (got < 0)
         {
-            self->tmp[2] = self->read_buffer.start;
-            self->tmp[3] = idx - self->read_buffer.start;
-            self->read_buffer.start = idx + 1;
-            self->state = 2;
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
         }
-    }
+        if (got <= 0)
+        {
+            evhttp_parser_finish(&self->parser);
+            goto close;
+        }
+        total += got;
 
-    if (self->state == 2)
-    {
-        int idx = buffer_find_chr(&self->read_buffer, '\n');
-        if (idx >= 0)
+        if (target)
         {
-            if (self->on_first_line)
-            {
-                int end = idx;
-                if (end > self->read_buffer.start && self->read_buffer.data[end-1] == '\r')
-                    --end;
-
-                evhttp_string_t first, second, third;
-
-                first.data = self->read_buffer.data + self->tmp[0];
-                first.length = self->tmp[1];
-                second.data = self->read_buffer.data + self->tmp[2];
-                second.length = self->tmp[3];
-                third.data = self->read_buffer.data + self->read_buffer.start;
-                third.length = end - self->read_buffer.start;
-
-                self->on_first_line(first, second, third, self->callback_data);
-                if (self->closing == CLOSE_REQESTED)
-                    goto close;
-            }
+            if (evhttp_parser_commit_target(&self->parser, got) != 0)
+                goto close;
+        }
+        else if (self->pool)
+        {
+            if (evhttp_parser_feed_in_place(&self->parser, space, got) != 0)
+                goto close;
+        }
+        else if (evhttp_parser_commit(&self->parser, got) != 0)
+            goto close;
 
-            self->read_buffer.start = idx + 1;
-            self->tmp[0] = 0; // chunked sent counter
-            self->state = 3;
+        // a full read means there is probably more to come,
+        // a short one means the socket is empty so the next
+        // read would only say EAGAIN
+        if (got == want)
+        {
+            if (!target && self->read_size < READ_SIZE_MAX)
+                self->read_size <<= 1;
+        }
+        else
+        {
+            if (!target && got < (self->read_size >> 2) && self->read_size > READ_SIZE_MIN)
+                self->read_size >>= 1;
+            break;
         }
     }
 
-    if (self->state == 3)
+    self->closing = CLOSE_OK;
+    if (self->timers)
     {
-        int newline;
-        for (newline = buffer_find_chr(&self->read_buffer, '\n'); newline >= 0; newline = buffer_find_chr(&self->read_buffer, '\n'))
-        {
-            int start = self->read_buffer.start;
-            int end = newline;
-            char *data = self->read_buffer.data;
-            if (end > start && data[end-1] == '\r')
-                --end;
+        if (total > 0)
+            self->read_at = ev_now(loop);
+        timers_touch(self);
+    }
+    // last, as writing can close
+    evhttp_connection_end_batch(self);
+    return;
+close:
+    --self->batching;
+    self->closing = CLOSE_OK;
+    evhttp_connection_close(self);
+}
 
-            if (end == start)
-            {
-                self->read_buffer.start = newline + 1;
-                self->state = 4;
-
-                if (self->on_headers_end)
-                {
-                    evhttp_string_t message;
-                    message.data = data;
-                    message.length = newline+1;
-                    self->on_headers_end(message, self->callback_data);
-                    if (self->closing == CLOSE_REQESTED)
-                        goto close;
-                }
+// Send some of a file segment, -1 with errno set if nothing could be sent
+static int send_file(connection_t *self, segment_t *segment)
+{
+    int sent;
 
-                break;
-            }
+    if (segment->kind == SEGMENT_FILE)
+        sent = sendfile(self->fd, segment->file, &segment->offset, segment->length);
+    else
+        sent = splice(segment->file, NULL, self->fd, NULL, segment->length, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (sent == 0)
+    {
+        // the file is shorter than it was said to be,
+        // or the pipe closed early, either way the rest
+        // is never coming
+        errno = EPIPE;
+        return -1;
+    }
+    return sent;
+}
 
-            int key_start, key_end, value_start, value_end;
-            int idx;
-            for (idx=start; idx<end; ++idx)
-            {
-                char c = data[idx];
-                if (c != ' ' && c != '\t')
-                    break;
-            }
-            key_start = idx;
+// Gather the memory at the head of the queue, up to the next file
+static int gather(connection_t *self, struct iovec *iov, int max)
+{
+    buffer_t *queue = &self->write_queue;
+    segment_t *head = (segment_t *)(queue->data + queue->start);
+    int count;
 
-            for (; idx<end; ++idx)
-            {
-                char c = data[idx];
-                if (c == ':' || c == ' ' || c == '\t')
-                    break;
-                data[idx] = tolower(c);
-            }
-            key_end = idx;
+    for (count=0; count<max && queue->start + count * (int)sizeof(segment_t) < queue->size; ++count)
+    {
+        segment_t *segment = head + count;
+        if (segment->kind != SEGMENT_MEMORY && segment->kind != SEGMENT_COPY)
+            break;
+        iov[count].iov_base = (void *)segment->data;
+        iov[count].iov_len = segment->length;
+    }
+    return count;
+}
 
-            for (; idx<end; ++idx)
-            {
-                char c = data[idx];
-                if (c == ':')
-                    break;
-            }
+// Write the memory at the head of the queue, -1 with errno set if
+// none could be, a file after it is flagged as more to come so the
+// two share segments
+static int write_memory(connection_t *self)
+{
+    buffer_t *queue = &self->write_queue;
+    struct iovec iov[WRITE_IOV_MAX];
+    struct msghdr message;
+    int count = gather(self, iov, WRITE_IOV_MAX);
+
+    if (queue->start + count * (int)sizeof(segment_t) == queue->size)
+        return writev(self->fd, iov, count);
+
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = iov;
+    message.msg_iovlen = count;
+    return sendmsg(self->fd, &message, MSG_MORE);
+}
 
-            for (++idx; idx<end; ++idx)
-            {
-                char c = data[idx];
-                if (c != ' ' && c != '\t')
-                    break;
-            }
-            value_start = idx;
+// Nothing is being written or waited on, so
+// a write now would not jump the queue
+static int can_write_now(connection_t *self)
+{
+    return !self->batching &&
+           !self->uring_link &&
+           self->closing != CLOSE_REQESTED &&
+           !ev_is_active(&self->write_watcher) &&
+           !ev_is_active(&self->file_watcher);
+}
 
-            for (idx=end-1; idx>value_start; --idx)
-            {
-                char c = data[idx];
-                if (c != ' ' && c != '\t')
-                    break;
-            }
-            value_end = idx+1;
+// Have the queue written, through the ring if there is one, or
+// straight away when nothing is ahead of it, leaving the watcher
+// for what the socket will not take. Files always go through the
+// watcher. Returns -1 if writing closed the connection.
+static int write_start(connection_t *self)
+{
+    buffer_t *queue = &self->write_queue;
+    segment_t *head = (segment_t *)(queue->data + queue->start);
+    int memory = head->kind == SEGMENT_MEMORY || head->kind == SEGMENT_COPY;
+    int sent;
 
-            evhttp_string_t key, value;
-            key.data = data + key_start;
-            key.length = key_end - key_start;
-            value.data = data + value_start;
-            value.length = value_end - value_start;
+    if (self->uring_link && memory)
+    {
+        ev_io_stop(self->loop, &self->write_watcher);
+        evhttp_uring_write(self->uring_link);
+        return 0;
+    }
+    // the end of the batch writes it all together
+    if (self->batching)
+        return 0;
+    if (!can_write_now(self) || !memory)
+    {
+        if (!ev_is_active(&self->file_watcher))
+            ev_io_start(self->loop, &self->write_watcher);
+        return 0;
+    }
 
-            if (self->content_length < 0 && key.length == 14 && !memcmp(data + key_start, "content-length", 14))
-            {
-                char *endptr;
-                int l = strtol(value.data, &endptr, 10);
-                if (l >= 0)
-                    self->content_length = l;
-                // TODO, check endptr
-            }
+    // started first so sends from the release
+    // callbacks queue up behind this write
+    ev_io_start(self->loop, &self->write_watcher);
+    sent = write_memory(self);
+    if (sent < 0)
+        return 0;
+    return written(self, sent);
+}
+
+void on_write(ev_loop_t *loop, ev_io_t *watcher, int revents)
+{
+    connection_t *self = (connection_t *)watcher->data;
+    buffer_t *queue = &self->write_queue;
+    segment_t *head = (segment_t *)(queue->data + queue->start);
+    int sent;
 
-            if (self->on_header)
+    if (head->kind == SEGMENT_FILE || head->kind == SEGMENT_PIPE)
+    {
+        sent = send_file(self, head);
+        if (sent < 0 && errno == EAGAIN && head->kind == SEGMENT_PIPE)
+        {
+            // wait for the pipe rather than spin on the socket
+            struct pollfd ready = { head->file, POLLIN, 0 };
+            if (poll(&ready, 1, 0) == 0)
             {
-                self->on_header(key, value, self->callback_data);
-                if (self->closing == CLOSE_REQESTED)
-                    goto close;
+                ev_io_stop(self->loop, &self->write_watcher);
+                ev_io_set(&self->file_watcher, head->file, EV_READ);
+                ev_io_start(self->loop, &self->file_watcher);
+                return;
             }
-
-            self->read_buffer.start = newline + 1;
         }
     }
+    else
+        sent = write_memory(self);
 
-    if (self->state == 4)
+    if (sent < 0)
     {
-        if (self->content_length < -1)
-            self->state = 5;
-        else
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+            return;
+        evhttp_connection_close(self);
+        return;
+    }
+
+    written(self, sent);
+}
+
+// Retire what was written, a release callback can send more so the
+// queue may move under us. Returns -1 if the connection closed.
+static int written(connection_t *self, int sent)
+{
+    buffer_t *queue = &self->write_queue;
+    // a write from a send can be inside another callback
+    int closing = self->closing;
+
+    self->closing = CLOSE_DELAY;
+    while (queue->start < queue->size)
+    {
+        segment_t *segment = (segment_t *)(queue->data + queue->start);
+        int written = sent < segment->length ? sent : segment->length;
+
+        sent -= written;
+        segment->length -= written;
+        self->write_queued -= written;
+        // sendfile has moved the offset itself
+        if (segment->kind == SEGMENT_MEMORY || segment->kind == SEGMENT_COPY)
+            segment->data += written;
+        if (segment->kind == SEGMENT_COPY)
         {
-            int len = self->read_buffer.size - self->read_buffer.start;
+            segment->block->written += written;
+            blocks_free(self, 0);
+        }
 
-            if (self->on_complete_content)
-            {
-                if (self->content_length >= 0 && self->content_length <= len)
-                {
-                    self->state = 5;
-                    evhttp_string_t content;
-                    content.data = self->read_buffer.data + self->read_buffer.start;
-                    content.length = self->content_length;
-                    self->on_complete_content(content, self->callback_data);
-                    if (self->closing == CLOSE_REQESTED)
-                        goto close;
-                }
-            }
-            else
-            {
-                if (self->on_chunk)
-                {
-                    evhttp_string_t content;
-                    content.data = self->read_buffer.data + self->read_buffer.start;
-                    content.length = len;
-                    self->on_chunk(content, self->callback_data);
-                    if (self->closing == CLOSE_REQESTED)
-                        goto close;
-                }
-
-                self->tmp[0] += len;
-                if (self->content_length >= 0 && self->content_length <= self->tmp[0])
-                    self->state = 5;
-                else
-                {
-                    self->read_buffer.start = 0;
-                    self->read_buffer.size = 0;
-                }
-            }
+        if (segment->length > 0)
+            break;
+
+        queue->start += sizeof(segment_t);
+        if (segment->on_release)
+        {
+            evhttp_connection_on_release on_release = segment->on_release;
+            on_release(segment->release_data);
+            if (self->closing == CLOSE_REQESTED)
+                goto close;
         }
     }
 
-    if (self->state == 5)
+    if (self->write_blocked && self->write_queued <= self->write_low)
     {
-        // keep alive not currently supported
-        // goto terminal state 6
-        self->state = 6;
-
-        if (self->on_complete)
+        self->write_blocked = 0;
+        if (self->on_write_drained)
         {
-            self->on_complete(self->callback_data);
+            self->on_write_drained(self->callback_data);
             if (self->closing == CLOSE_REQESTED)
                 goto close;
         }
     }
+    self->closing = closing;
 
-    if (self->state == 6)
+    if (queue->start == queue->size)
     {
-        // terminal state, just absorb
-        // any further data
-        self->read_buffer.start = 0;
-        self->read_buffer.size = 0;
+        if (self->terminating)
+            goto close;
+
+        queue->start = 0;
+        queue->size = 0;
+        if (self->pool)
+            evhttp_buffer_free(queue);
+        ev_io_stop(self->loop, &self->write_watcher);
     }
+    // the ring writes once per completion, and a file
+    // at the head goes back to the write watcher
+    else if (self->uring_link)
+        write_start(self);
+
+    if (self->timers)
+    {
+        self->write_at = ev_now(self->loop);
+        timers_touch(self);
+    }
+    return 0;
 
-    self->closing = CLOSE_OK;
-    return;
 close:
-    self->closing = CLOSE_OK;
+    self->closing = closing;
     evhttp_connection_close(self);
+    return -1;
 }
 
-void on_write(ev_loop_t *loop, ev_io_t *watcher, int revents)
+void on_file_ready(ev_loop_t *loop, ev_io_t *watcher, int revents)
 {
     connection_t *self = (connection_t *)watcher->data;
-    int start = self->write_buffer.start;
-    int sent = write(self->fd, self->write_buffer.data + start, self->write_buffer.size - start);
-    if (sent < 0)
-        goto close;
-    self->write_buffer.start += sent;
-    if (self->terminating && self->write_buffer.start == self->write_buffer.size)
-        goto close;
-    if (self->write_buffer.start == self->write_buffer.size)
-    {
-        self->write_buffer.start = 0;
-        self->write_buffer.size = 0;
-        ev_io_stop(self->loop, &self->write_watcher);
+    ev_io_stop(self->loop, &self->file_watcher);
+    ev_io_start(self->loop, &self->write_watcher);
+}
+
+///
+// io_uring
+///
+
+int evhttp_connection_use_uring(evhttp_connection_t *self, evhttp_uring_t *uring)
+{
+    evhttp_uring_link_t *link = evhttp_uring_attach(uring, self->fd, on_ring_read, on_ring_gather, on_ring_written, self);
+    if (!link)
+        return -1;
+
+    self->uring = uring;
+    self->uring_link = link;
+    if (uring->multishot)
+        ev_io_stop(self->loop, &self->read_watcher);
+    if (self->read_paused)
+        evhttp_uring_read_stop(link);
+    if (self->write_queue.start < self->write_queue.size)
+        write_start(self);
+    return 0;
+}
+
+void on_ring_read(void *data, char *buffer, int result)
+{
+    connection_t *self = (connection_t *)data;
+
+    // no multishot recv, so read as before
+    if (result == -EINVAL && !self->uring->multishot)
+    {
+        if (!self->read_paused)
+            ev_io_start(self->loop, &self->read_watcher);
+        return;
     }
-    return;
 
-close:
-    evhttp_connection_close(self);
+    // a callback closing is put off until the end, as on_read does
+    self->closing = CLOSE_DELAY;
+    if (result <= 0)
+    {
+        evhttp_parser_finish(&self->parser);
+        self->closing = CLOSE_OK;
+        evhttp_connection_close(self);
+        return;
+    }
+
+    // data from a recv still being cancelled is held
+    // by the parser until the read is resumed
+    if (evhttp_parser_feed_in_place(&self->parser, buffer, result) != 0)
+    {
+        self->closing = CLOSE_OK;
+        evhttp_connection_close(self);
+        return;
+    }
+    self->closing = CLOSE_OK;
+    if (self->timers)
+    {
+        self->read_at = ev_now(self->loop);
+        timers_touch(self);
+    }
+}
+
+int on_ring_gather(void *data, struct iovec *iov, int max)
+{
+    return gather((connection_t *)data, iov, max);
+}
+
+void on_ring_written(void *data, int result)
+{
+    connection_t *self = (connection_t *)data;
+
+    if (result == -EAGAIN || result == -EINTR)
+        write_start(self);
+    else if (result < 0)
+        evhttp_connection_close(self);
+    else
+        written(self, result);
 }
@@ -1,19 +1,14 @@
 #include <ev.h>
+#include <sys/uio.h>
+#include <sys/types.h>
 
-// Callback singatures
+#include "evhttpparser.h"
+#include "evhttppool.h"
+#include "evhttptimer.h"
+#include "evhttpuring.h"
 
-typedef struct
-{
-    const char *data;
-    int length;
-} evhttp_string_t;
-
-typedef void (*evhttp_connection_on_first_line)(evhttp_string_t first, evhttp_string_t second, evhttp_string_t third, void *data);
-typedef void (*evhttp_connection_on_header)(evhttp_string_t key, evhttp_string_t value, void *data);
-typedef void (*evhttp_connection_on_headers_end)(evhttp_string_t message, void *data);
-typedef void (*evhttp_connection_on_content)(evhttp_string_t content, void *data);
-typedef void (*evhttp_connection_on_complete)(void *data);
-typedef void (*evhttp_connection_on_close)(void *data);
+typedef void (*evhttp_connection_on_release)(void *data);
+typedef void (*evhttp_connection_on_write)(void *data);
 
 typedef struct evhttp_connection evhttp_connection_t;
 
@@ -28,43 +23,154 @@ void evhttp_connection_init(evhttp_connection_t *self,
                             evhttp_connection_on_complete on_complete,
                             evhttp_connection_on_close on_close,
                             void *callback_data);
+// As evhttp_connection_init but with buffers taken from pool, which
+// must belong to the same loop and outlive the connection
+void evhttp_connection_init_with_pool(evhttp_connection_t *self,
+                                      struct ev_loop *loop,
+                                      evhttp_pool_t *pool,
+                                      int fd,
+                                      evhttp_connection_on_first_line on_first_line,
+                                      evhttp_connection_on_header on_header,
+                                      evhttp_connection_on_headers_end on_headers_end,
+                                      evhttp_connection_on_content on_chunk,
+                                      evhttp_connection_on_content on_complete_content,
+                                      evhttp_connection_on_complete on_complete,
+                                      evhttp_connection_on_close on_close,
+                                      void *callback_data);
 void evhttp_connection_close(evhttp_connection_t *self);
+// Have headers go to on_header_id in place of on_header
+void evhttp_connection_set_on_header_id(evhttp_connection_t *self, evhttp_connection_on_header_id on_header_id);
+// Have headers collected into the caller's array and handed to
+// on_headers, see evhttp_parser_set_on_headers
+void evhttp_connection_set_on_headers(evhttp_connection_t *self, evhttp_header_t *headers, int max_headers, evhttp_connection_on_headers on_headers);
+// Have bodies read straight into memory from on_body_target, see
+// evhttp_parser_set_on_body_target
+void evhttp_connection_set_on_body_target(evhttp_connection_t *self, evhttp_connection_on_body_target on_body_target);
 
 int evhttp_connection_send(evhttp_connection_t *self, evhttp_string_t data);
-//char *evhttp_connection_make_send_buffer(evhttp_connection_t *self, int length);
+// Send without copying, the memory stays the caller's and must not
+// change until on_release, which comes once it is all written or
+// the connection closes. Through uring, a write still in flight at
+// the close puts that off until the write is over, which can be after
+// on_close. Sends of all kinds go out in order.
+int evhttp_connection_send_ref(evhttp_connection_t *self, evhttp_string_t data, evhttp_connection_on_release on_release, void *release_data);
+// As send_ref for count pieces released together, each under 2GB
+int evhttp_connection_sendv(evhttp_connection_t *self, const struct iovec *iov, int count, evhttp_connection_on_release on_release, void *release_data);
+// Send length bytes of a file from offset without them passing through
+// memory, pipes are spliced from wherever they are up to. The file
+// must stay open until on_release. Returns -1 if the file is too short,
+// and one cut short after this closes the connection.
+int evhttp_connection_sendfile(evhttp_connection_t *self, int file_fd, off_t offset, off_t length, evhttp_connection_on_release on_release, void *release_data);
+// on_write_blocked is called once high or more bytes are waiting to be
+// written, and on_write_drained once that is back down to low, so a
+// producer can hold off rather than queue without limit. Sends still
+// work while blocked. A high of 0, the default, turns this off.
+void evhttp_connection_set_write_watermarks(evhttp_connection_t *self,
+                                            off_t low,
+                                            off_t high,
+                                            evhttp_connection_on_write on_write_blocked,
+                                            evhttp_connection_on_write on_write_drained);
+// The number of bytes waiting to be written
+off_t evhttp_connection_write_queued(evhttp_connection_t *self);
+// Sends are written straight away when nothing is queued ahead of
+// them. Between these they are only queued, and go out together at
+// the end so the parts of a response share TCP segments. Batches
+// nest, and everything sent from the read callbacks is one batch.
+void evhttp_connection_begin_batch(evhttp_connection_t *self);
+void evhttp_connection_end_batch(evhttp_connection_t *self);
+// Send a request and queue request_data, replies are matched to
+// requests in order so any number can be in flight at once. A send
+// that fails part way leaves request_data queued, as some of the
+// request is already out.
+int evhttp_connection_send_request(evhttp_connection_t *self, evhttp_string_t data, void *request_data);
+// Space for the next length bytes to send, to format in place and
+// then pass to evhttp_connection_commit_send_buffer with how much
+// was used. The space is only good until the next send of any kind.
+char *evhttp_connection_make_send_buffer(evhttp_connection_t *self, int length);
+void evhttp_connection_commit_send_buffer(evhttp_connection_t *self, int length);
 void evhttp_connection_terminate(evhttp_connection_t *self);
 
-// Internal structs, defined so evhttp_connection_t can be put on the stack
+// Stop reading and hold back callbacks from the next one on, for
+// when what is being read can not be dealt with yet. The peer is
+// held back too once the socket buffers fill up.
+void evhttp_connection_pause_read(evhttp_connection_t *self);
+void evhttp_connection_resume_read(evhttp_connection_t *self);
+// The largest body on_complete_content will hold, a bigger
+// one closes the connection, 0 for no limit
+void evhttp_connection_set_max_body(evhttp_connection_t *self, int64_t max_body);
+// Record when each message reached its first byte, first line,
+// end of headers and completion, which callbacks can then read
+// up to and including on_complete
+void evhttp_connection_set_timing(evhttp_connection_t *self, int timing);
+const evhttp_timing_t *evhttp_connection_timing(evhttp_connection_t *self);
+// Close the connection when it runs over the timeouts set on timers
+// with evhttp_timers_set_timeouts. The timers must belong to the same
+// loop and outlive the connection. The timeouts are the header
+// timeout from the first byte of a message to the end of its
+// headers, the body timeout between reads of a body, the idle
+// timeout between messages and the write timeout between writes
+// while there is something to write. The close comes through
+// on_close as any other does.
+void evhttp_connection_use_timers(evhttp_connection_t *self, evhttp_timers_t *timers);
+// Non zero if the connection was closed by a timeout
+int evhttp_connection_timed_out(evhttp_connection_t *self);
+// Do the reads and the writes of memory through uring, which must
+// belong to the same loop and outlive the connection. Files still
+// go through sendfile. Returns -1, carrying on as before, if the
+// socket could not be added.
+int evhttp_connection_use_uring(evhttp_connection_t *self, evhttp_uring_t *uring);
 
-typedef struct
-{
-    char *data;
-    int start;
-    int size;
-    int allocated;
-} evhttp_buffer_t;
+// Non zero if the connection stays open after the current message
+int evhttp_connection_keep_alive(evhttp_connection_t *self);
+// The request_data of the request the current message answers,
+// or NULL, valid from on_first_line to on_complete
+void *evhttp_connection_request_data(evhttp_connection_t *self);
+// The number of requests sent and not yet answered
+int evhttp_connection_in_flight(evhttp_connection_t *self);
+
+// Internal structs, defined so evhttp_connection_t can be put on the stack
 
 struct evhttp_connection
 {
+    // ordered by use, all in the one struct: what every read
+    // touches comes first so it shares cache lines
     struct ev_loop *loop;
     int fd;
-    evhttp_buffer_t read_buffer;
-    evhttp_buffer_t write_buffer;
+    int read_size;
+    int read_paused;
+    int closing;
+    evhttp_pool_t *pool;
     struct ev_io read_watcher;
-    struct ev_io write_watcher;
+    evhttp_parser_t parser;
 
-    int state;
-    int content_length;
-    int tmp[4];
+    // then writing, with timeouts and uring after
+    struct evhttp_write_block *write_head;
+    struct evhttp_write_block *write_tail;
+    evhttp_buffer_t write_queue;
+    off_t write_queued;
+    off_t write_low;
+    off_t write_high;
+    int write_blocked;
+    int batching; // depth
+    evhttp_buffer_t requests;
+    int answered;
     int terminating;
-    int closing;
+    struct ev_io write_watcher;
+    struct ev_io file_watcher;
+
+    evhttp_timers_t *timers;
+    evhttp_timer_t timer;
+    ev_tstamp read_at; // the last read, or the end of the last message
+    ev_tstamp head_at; // the start of the current message's head
+    ev_tstamp write_at; // the last write, or when writing started
+    int head_messages; // the message head_at was for
+    int timed_out;
+
+    evhttp_uring_t *uring;
+    evhttp_uring_link_t *uring_link;
 
-    evhttp_connection_on_first_line on_first_line;
-    evhttp_connection_on_header on_header;
-    evhttp_connection_on_headers_end on_headers_end;
-    evhttp_connection_on_content on_chunk;
-    evhttp_connection_on_content on_complete_content;
-    evhttp_connection_on_complete on_complete;
+    evhttp_connection_on_write on_write_blocked;
+    evhttp_connection_on_write on_write_drained;
     evhttp_connection_on_close on_close;
     void *callback_data;
 };
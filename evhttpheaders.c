@@ -0,0 +1,112 @@
+// Generated by header_gen, do not edit
+
+#include "evhttpheaders.h"
+
+const char *const evhttp_header_names[EVHTTP_HEADER_COUNT] =
+{
+    "",
+    "accept",
+    "accept-charset",
+    "accept-encoding",
+    "accept-language",
+    "accept-ranges",
+    "access-control-allow-credentials",
+    "access-control-allow-headers",
+    "access-control-allow-methods",
+    "access-control-allow-origin",
+    "access-control-expose-headers",
+    "access-control-max-age",
+    "access-control-request-headers",
+    "access-control-request-method",
+    "age",
+    "allow",
+    "alt-svc",
+    "authorization",
+    "cache-control",
+    "connection",
+    "content-disposition",
+    "content-encoding",
+    "content-language",
+    "content-length",
+    "content-location",
+    "content-range",
+    "content-security-policy",
+    "content-type",
+    "cookie",
+    "date",
+    "dnt",
+    "etag",
+    "expect",
+    "expires",
+    "forwarded",
+    "from",
+    "host",
+    "if-match",
+    "if-modified-since",
+    "if-none-match",
+    "if-range",
+    "if-unmodified-since",
+    "keep-alive",
+    "last-modified",
+    "link",
+    "location",
+    "max-forwards",
+    "origin",
+    "pragma",
+    "proxy-authenticate",
+    "proxy-authorization",
+    "range",
+    "referer",
+    "refresh",
+    "retry-after",
+    "server",
+    "set-cookie",
+    "strict-transport-security",
+    "te",
+    "trailer",
+    "transfer-encoding",
+    "upgrade",
+    "upgrade-insecure-requests",
+    "user-agent",
+    "vary",
+    "via",
+    "warning",
+    "www-authenticate",
+    "x-content-type-options",
+    "x-forwarded-for",
+    "x-forwarded-host",
+    "x-forwarded-proto",
+    "x-frame-options",
+    "x-real-ip",
+    "x-request-id",
+    "x-requested-with",
+};
+
+const unsigned char evhttp_header_lengths[EVHTTP_HEADER_COUNT] =
+{
+    0, 6, 14, 15, 15, 13, 32, 28, 28, 27, 29, 22, 30, 29, 3, 5,
+    7, 13, 13, 10, 19, 16, 16, 14, 16, 13, 23, 12, 6, 4, 3, 4,
+    6, 7, 9, 4, 4, 8, 17, 13, 8, 19, 10, 13, 4, 8, 12, 6,
+    6, 18, 19, 5, 7, 7, 11, 6, 10, 25, 2, 7, 17, 7, 25, 10,
+    4, 3, 7, 16, 22, 15, 16, 17, 15, 9, 12, 16,
+};
+
+const unsigned char evhttp_header_slots[256] =
+{
+    0, 73, 14, 0, 0, 0, 0, 0, 0, 0, 0, 9, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 68, 46, 17, 0, 45,
+    0, 67, 0, 0, 0, 0, 18, 0, 0, 0, 0, 0, 0, 23, 75, 70,
+    0, 47, 0, 0, 0, 0, 0, 0, 13, 0, 0, 0, 0, 0, 40, 0,
+    0, 0, 0, 0, 0, 63, 4, 16, 0, 0, 0, 52, 20, 0, 0, 0,
+    0, 0, 0, 0, 38, 0, 0, 0, 30, 0, 0, 0, 2, 10, 42, 0,
+    0, 0, 0, 0, 56, 0, 0, 0, 49, 0, 0, 0, 0, 3, 22, 0,
+    32, 0, 0, 0, 0, 0, 0, 0, 26, 48, 0, 24, 8, 0, 0, 5,
+    0, 0, 36, 11, 1, 0, 0, 0, 0, 0, 41, 0, 0, 0, 0, 28,
+    0, 64, 0, 0, 34, 21, 0, 71, 15, 0, 0, 0, 0, 25, 0, 29,
+    0, 0, 6, 57, 62, 0, 66, 37, 43, 0, 0, 0, 61, 0, 39, 0,
+    31, 0, 0, 69, 0, 0, 0, 54, 0, 74, 0, 0, 0, 0, 0, 0,
+    0, 0, 7, 0, 0, 0, 0, 0, 0, 35, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 58, 27, 44, 0, 0, 59, 19, 0, 0, 0, 0, 72, 0,
+    60, 0, 50, 0, 0, 0, 0, 0, 51, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 65, 0, 0, 55, 33, 12, 0, 0, 0, 53, 0, 0, 0,
+};
@@ -0,0 +1,119 @@
+// Generated by header_gen, do not edit
+
+#ifndef EVHTTPHEADERS_H
+#define EVHTTPHEADERS_H
+
+#include <string.h>
+
+// The header names known to the parser, for on_header_id
+
+typedef enum
+{
+    EVHTTP_HEADER_OTHER = 0,
+    EVHTTP_HEADER_ACCEPT,
+    EVHTTP_HEADER_ACCEPT_CHARSET,
+    EVHTTP_HEADER_ACCEPT_ENCODING,
+    EVHTTP_HEADER_ACCEPT_LANGUAGE,
+    EVHTTP_HEADER_ACCEPT_RANGES,
+    EVHTTP_HEADER_ACCESS_CONTROL_ALLOW_CREDENTIALS,
+    EVHTTP_HEADER_ACCESS_CONTROL_ALLOW_HEADERS,
+    EVHTTP_HEADER_ACCESS_CONTROL_ALLOW_METHODS,
+    EVHTTP_HEADER_ACCESS_CONTROL_ALLOW_ORIGIN,
+    EVHTTP_HEADER_ACCESS_CONTROL_EXPOSE_HEADERS,
+    EVHTTP_HEADER_ACCESS_CONTROL_MAX_AGE,
+    EVHTTP_HEADER_ACCESS_CONTROL_REQUEST_HEADERS,
+    EVHTTP_HEADER_ACCESS_CONTROL_REQUEST_METHOD,
+    EVHTTP_HEADER_AGE,
+    EVHTTP_HEADER_ALLOW,
+    EVHTTP_HEADER_ALT_SVC,
+    EVHTTP_HEADER_AUTHORIZATION,
+    EVHTTP_HEADER_CACHE_CONTROL,
+    EVHTTP_HEADER_CONNECTION,
+    EVHTTP_HEADER_CONTENT_DISPOSITION,
+    EVHTTP_HEADER_CONTENT_ENCODING,
+    EVHTTP_HEADER_CONTENT_LANGUAGE,
+    EVHTTP_HEADER_CONTENT_LENGTH,
+    EVHTTP_HEADER_CONTENT_LOCATION,
+    EVHTTP_HEADER_CONTENT_RANGE,
+    EVHTTP_HEADER_CONTENT_SECURITY_POLICY,
+    EVHTTP_HEADER_CONTENT_TYPE,
+    EVHTTP_HEADER_COOKIE,
+    EVHTTP_HEADER_DATE,
+    EVHTTP_HEADER_DNT,
+    EVHTTP_HEADER_ETAG,
+    EVHTTP_HEADER_EXPECT,
+    EVHTTP_HEADER_EXPIRES,
+    EVHTTP_HEADER_FORWARDED,
+    EVHTTP_HEADER_FROM,
+    EVHTTP_HEADER_HOST,
+    EVHTTP_HEADER_IF_MATCH,
+    EVHTTP_HEADER_IF_MODIFIED_SINCE,
+    EVHTTP_HEADER_IF_NONE_MATCH,
+    EVHTTP_HEADER_IF_RANGE,
+    EVHTTP_HEADER_IF_UNMODIFIED_SINCE,
+    EVHTTP_HEADER_KEEP_ALIVE,
+    EVHTTP_HEADER_LAST_MODIFIED,
+    EVHTTP_HEADER_LINK,
+    EVHTTP_HEADER_LOCATION,
+    EVHTTP_HEADER_MAX_FORWARDS,
+    EVHTTP_HEADER_ORIGIN,
+    EVHTTP_HEADER_PRAGMA,
+    EVHTTP_HEADER_PROXY_AUTHENTICATE,
+    EVHTTP_HEADER_PROXY_AUTHORIZATION,
+    EVHTTP_HEADER_RANGE,
+    EVHTTP_HEADER_REFERER,
+    EVHTTP_HEADER_REFRESH,
+    EVHTTP_HEADER_RETRY_AFTER,
+    EVHTTP_HEADER_SERVER,
+    EVHTTP_HEADER_SET_COOKIE,
+    EVHTTP_HEADER_STRICT_TRANSPORT_SECURITY,
+    EVHTTP_HEADER_TE,
+    EVHTTP_HEADER_TRAILER,
+    EVHTTP_HEADER_TRANSFER_ENCODING,
+    EVHTTP_HEADER_UPGRADE,
+    EVHTTP_HEADER_UPGRADE_INSECURE_REQUESTS,
+    EVHTTP_HEADER_USER_AGENT,
+    EVHTTP_HEADER_VARY,
+    EVHTTP_HEADER_VIA,
+    EVHTTP_HEADER_WARNING,
+    EVHTTP_HEADER_WWW_AUTHENTICATE,
+    EVHTTP_HEADER_X_CONTENT_TYPE_OPTIONS,
+    EVHTTP_HEADER_X_FORWARDED_FOR,
+    EVHTTP_HEADER_X_FORWARDED_HOST,
+    EVHTTP_HEADER_X_FORWARDED_PROTO,
+    EVHTTP_HEADER_X_FRAME_OPTIONS,
+    EVHTTP_HEADER_X_REAL_IP,
+    EVHTTP_HEADER_X_REQUEST_ID,
+    EVHTTP_HEADER_X_REQUESTED_WITH,
+    EVHTTP_HEADER_COUNT
+} evhttp_header_id_t;
+
+// Lowercase names by id
+extern const char *const evhttp_header_names[EVHTTP_HEADER_COUNT];
+extern const unsigned char evhttp_header_lengths[EVHTTP_HEADER_COUNT];
+extern const unsigned char evhttp_header_slots[256];
+
+#define EVHTTP_HEADER_MAX_LENGTH 32
+
+static inline unsigned evhttp_header_hash(const char *key, int length)
+{
+    unsigned key_bytes = (unsigned)length << 24 |
+                         (unsigned)(unsigned char)key[0] << 16 |
+                         (unsigned)(unsigned char)key[length - 2] << 8 |
+                         (unsigned)(unsigned char)key[length - 1];
+    return (key_bytes * 1108821659u) >> 24;
+}
+
+// The id of a lowercase key, EVHTTP_HEADER_OTHER if it is not known
+static inline evhttp_header_id_t evhttp_header_id(const char *key, int length)
+{
+    int id;
+    if (length < 2 || length > EVHTTP_HEADER_MAX_LENGTH)
+        return EVHTTP_HEADER_OTHER;
+    id = evhttp_header_slots[evhttp_header_hash(key, length)];
+    if (evhttp_header_lengths[id] != length || memcmp(evhttp_header_names[id], key, length))
+        return EVHTTP_HEADER_OTHER;
+    return (evhttp_header_id_t)id;
+}
+
+#endif
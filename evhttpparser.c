@@ -0,0 +1,931 @@
+#include "evhttpparser.h"
+#include "evhttpbuffer.h"
+#include "evhttpscan.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <limits.h>
+#include <stdint.h>
+#include <time.h>
+
+typedef evhttp_buffer_t buffer_t;
+typedef evhttp_parser_t parser_t;
+
+///
+// Buffers
+///
+
+static int buffer_find_chr(buffer_t *self, int *scanned, char c)
+{
+    // nothing before scanned matched last time, so
+    // carry on from there rather than from start
+    int from = *scanned > self->start ? *scanned : self->start;
+    int idx = evhttp_scanner->find_chr(self->data, from, self->size, c);
+    *scanned = idx < 0 ? self->size : idx;
+    return idx;
+}
+
+///
+// Timing
+///
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+///
+// Header values
+///
+
+static int is_http11(evhttp_string_t version)
+{
+    // anything from HTTP/1.1 on defaults to keep alive
+    return version.length >= 8 && !memcmp(version.data, "HTTP/1.", 7) && version.data[7] != '0';
+}
+
+static int64_t parse_hex(const char *data, int length)
+{
+    // chunk sizes, stops at any extension
+    int idx;
+    int64_t value = 0;
+    for (idx=0; idx<length; ++idx)
+    {
+        char c = data[idx];
+        int digit;
+        if (c >= '0' && c <= '9')
+            digit = c - '0';
+        else if (c >= 'a' && c <= 'f')
+            digit = c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F')
+            digit = c - 'A' + 10;
+        else
+            break;
+
+        if (value > (INT64_MAX >> 4))
+            return -1;
+        value = (value << 4) | digit;
+    }
+    return idx ? value : -1;
+}
+
+static int64_t parse_decimal(const char *data, int length)
+{
+    // content-length, nothing but digits
+    int idx;
+    int64_t value = 0;
+    for (idx=0; idx<length; ++idx)
+    {
+        char c = data[idx];
+        if (c < '0' || c > '9')
+            return -1;
+        if (value > (INT64_MAX - (c - '0')) / 10)
+            return -1;
+        value = value * 10 + (c - '0');
+    }
+    return idx ? value : -1;
+}
+
+static int has_token(evhttp_string_t value, const char *token, int length)
+{
+    // case insensitive search of a comma separated list
+    int idx = 0;
+    while (idx < value.length)
+    {
+        int start, end;
+        while (idx < value.length && (value.data[idx] == ',' || value.data[idx] == ' ' || value.data[idx] == '\t'))
+            ++idx;
+        start = idx;
+        while (idx < value.length && value.data[idx] != ',')
+            ++idx;
+        end = idx;
+        while (end > start && (value.data[end-1] == ' ' || value.data[end-1] == '\t'))
+            --end;
+        if (end - start == length && !strncasecmp(value.data + start, token, length))
+            return 1;
+    }
+    return 0;
+}
+
+
+///
+// Parsing
+///
+
+// Space for length more bytes, or for the rest of a body that has to
+// be held whole if that is more, so it is allocated once rather than
+// doubled up to size as it arrives
+static int make_space(parser_t *self, int length)
+{
+    if (self->state == 4 && self->on_complete_content && !self->target &&
+        self->content_length >= 0 && self->content_length <= INT_MAX)
+    {
+        int64_t left = self->content_length - (self->buffer.size - self->buffer.start);
+        if (left > length)
+            length = left;
+    }
+    return evhttp_buffer_make_space(&self->buffer, length);
+}
+
+// The first offset in the buffer that is still needed
+static int keep_from(parser_t *self)
+{
+    // the headers end callback gets the whole head
+    if (self->state >= 1 && self->state <= 3)
+        return self->message;
+    if (self->state >= 7 && self->on_complete_content)
+        return self->tmp[3] - self->body_read;
+    return self->buffer.start;
+}
+
+// Move every offset into the buffer down by keep
+static void rebase(parser_t *self, int keep)
+{
+    self->buffer.start -= keep;
+    self->buffer.size -= keep;
+    self->scanned = self->scanned > keep ? self->scanned - keep : 0;
+    self->message = self->message > keep ? self->message - keep : 0;
+
+    if (self->state == 1 || self->state == 2)
+        self->tmp[0] -= keep; // method or version
+    if (self->state == 2)
+        self->tmp[2] -= keep; // path or status
+    if (self->state >= 7 && self->on_complete_content)
+        self->tmp[3] -= keep;
+}
+
+// Run the state machine over the buffer, returns 1 if a message
+// completed and more data is waiting, -1 if a callback halted
+// the parser or the message is malformed and 0 otherwise.
+static int parse(parser_t *self)
+{
+    if (self->state == 0)
+    {
+        // skip blank lines between messages
+        while (self->buffer.start < self->buffer.size &&
+               (self->buffer.data[self->buffer.start] == '\r' ||
+                self->buffer.data[self->buffer.start] == '\n'))
+            ++self->buffer.start;
+
+        if (self->timing && !self->times.first_byte && self->buffer.start < self->buffer.size)
+            self->times.first_byte = now();
+
+        // move the message down to the start of the buffer, but
+        // only if that costs no more than what is being dropped,
+        // so a long run of messages is not copied over and over
+        if (self->buffer.start >= self->buffer.size - self->buffer.start)
+        {
+            self->scanned -= self->buffer.start;
+            evhttp_buffer_compact(&self->buffer);
+        }
+        self->message = self->buffer.start;
+
+        int idx = buffer_find_chr(&self->buffer, &self->scanned, ' ');
+        if (idx >= 0)
+        {
+            self->tmp[0] = self->buffer.start;
+            self->tmp[1] = idx - self->buffer.start;
+            self->buffer.start = idx + 1;
+            self->state = 1;
+
+            // if the message starts with HTTP then it is a
+            // reply, so handle unspecified content-length,
+            // a request only has a body if it says so
+            if (self->tmp[1] >= 5 && !memcmp(self->buffer.data + self->tmp[0], "HTTP/", 5))
+                self->content_length = -1;
+            else
+                self->content_length = -2;
+        }
+    }
+
+    if (self->state == 1)
+    {
+        int idx = buffer_find_chr(&self->buffer, &self->scanned, ' ');
+        if (idx >= 0)
+        {
+            self->tmp[2] = self->buffer.start;
+            self->tmp[3] = idx - self->buffer.start;
+            self->buffer.start = idx + 1;
+            self->state = 2;
+        }
+    }
+
+    // a pause takes effect before the next callback, with
+    // each state left as it was so the step can be rerun
+
+    if (self->state == 2)
+    {
+        if (self->paused)
+            return 0;
+
+        int idx = buffer_find_chr(&self->buffer, &self->scanned, '\n');
+        if (idx >= 0)
+        {
+            int end = idx;
+            if (end > self->buffer.start && self->buffer.data[end-1] == '\r')
+                --end;
+
+            evhttp_string_t first, second, third;
+
+            first.data = self->buffer.data + self->tmp[0];
+            first.length = self->tmp[1];
+            second.data = self->buffer.data + self->tmp[2];
+            second.length = self->tmp[3];
+            third.data = self->buffer.data + self->buffer.start;
+            third.length = end - self->buffer.start;
+
+            // the version gives the keep alive default,
+            // a connection header can override it
+            if (self->content_length == -1)
+            {
+                self->keep_alive = is_http11(first);
+                self->tmp[1] = second.length == 3 ? strtol(second.data, NULL, 10) : 0; // status code
+            }
+            else
+            {
+                self->keep_alive = is_http11(third);
+                self->tmp[1] = 0;
+            }
+
+            if (self->timing)
+                self->times.first_line = now();
+            if (self->on_first_line)
+            {
+                self->on_first_line(first, second, third, self->callback_data);
+                if (self->halted)
+                    return -1;
+            }
+
+            self->buffer.start = idx + 1;
+            self->body_read = 0;
+            self->header_count = 0;
+            self->state = 3;
+        }
+    }
+
+    if (self->state == 3)
+    {
+        int newline;
+        for (newline = buffer_find_chr(&self->buffer, &self->scanned, '\n'); newline >= 0; newline = buffer_find_chr(&self->buffer, &self->scanned, '\n'))
+        {
+            if (self->paused)
+                return 0;
+
+            int start = self->buffer.start;
+            int end = newline;
+            char *data = self->buffer.data;
+            if (end > start && data[end-1] == '\r')
+                --end;
+
+            if (end == start)
+            {
+                self->buffer.start = newline + 1;
+                self->state = 4;
+
+                // 1xx, 204 and 304 replies never have a body
+                if ((self->tmp[1] >= 100 && self->tmp[1] < 200) || self->tmp[1] == 204 || self->tmp[1] == 304)
+                    self->content_length = -2;
+                // a body that runs until the close ends the stream
+                else if (self->content_length == -1)
+                    self->keep_alive = 0;
+
+                evhttp_string_t message;
+                message.data = data + self->message;
+                message.length = newline + 1 - self->message;
+
+                if (self->timing)
+                    self->times.headers_end = now();
+                if (self->on_headers)
+                {
+                    // now the head has stopped moving the
+                    // offsets can be made into pointers
+                    evhttp_header_t *header, *end = self->headers + self->header_count;
+                    for (header=self->headers; header<end; ++header)
+                    {
+                        header->key.data = message.data + (intptr_t)header->key.data;
+                        header->value.data = message.data + (intptr_t)header->value.data;
+                    }
+
+                    self->on_headers(self->headers, self->header_count, message, self->callback_data);
+                    if (self->halted)
+                        return -1;
+                }
+
+                if (self->on_headers_end)
+                {
+                    self->on_headers_end(message, self->callback_data);
+                    if (self->halted)
+                        return -1;
+                }
+
+                if (self->on_body_target && self->content_length > 0)
+                {
+                    self->target = self->on_body_target(self->content_length, self->callback_data);
+                    if (self->halted)
+                        return -1;
+                }
+
+                break;
+            }
+
+            int key_start, key_end, value_start, value_end;
+            int idx;
+            key_start = evhttp_scanner->skip_space(data, start, end);
+            key_end = evhttp_scanner->find_key_end(data, key_start, end);
+
+            idx = data[key_end] == ':' ? key_end : evhttp_scanner->find_chr(data, key_end, end, ':');
+            if (idx < 0)
+                idx = end;
+            else
+                ++idx;
+
+            value_start = evhttp_scanner->skip_space(data, idx, end);
+
+            for (idx=end-1; idx>value_start; --idx)
+            {
+                char c = data[idx];
+                if (c != ' ' && c != '\t')
+                    break;
+            }
+            value_end = idx+1;
+
+            evhttp_string_t key, value;
+            key.data = data + key_start;
+            key.length = key_end - key_start;
+            value.data = data + value_start;
+            value.length = value_end - value_start;
+
+            // the key is lowercase by now
+            evhttp_header_id_t id = evhttp_header_id(key.data, key.length);
+
+            // a length that could be read two ways is refused, as
+            // anything framing it differently would see another
+            // message in the body, RFC 9112 section 6.3
+            if (id == EVHTTP_HEADER_CONTENT_LENGTH)
+            {
+                int64_t l = parse_decimal(value.data, value.length);
+                if (l < 0 || self->content_length == -3)
+                    return -1;
+                if (self->content_length >= 0 && self->content_length != l)
+                    return -1;
+                self->content_length = l;
+            }
+            else if (id == EVHTTP_HEADER_TRANSFER_ENCODING)
+            {
+                if (has_token(value, "chunked", 7))
+                {
+                    if (self->content_length >= 0)
+                        return -1;
+                    self->content_length = -3;
+                }
+            }
+            else if (id == EVHTTP_HEADER_CONNECTION)
+            {
+                if (has_token(value, "close", 5))
+                    self->keep_alive = 0;
+                else if (has_token(value, "keep-alive", 10))
+                    self->keep_alive = 1;
+            }
+
+            if (self->on_headers)
+            {
+                // offsets from the start of the message, as
+                // the buffer can move before the head ends
+                evhttp_header_t *header;
+                if (self->header_count == self->max_headers)
+                    return -1;
+                header = self->headers + self->header_count++;
+                header->key.data = (const char *)(intptr_t)(key_start - self->message);
+                header->key.length = key.length;
+                header->value.data = (const char *)(intptr_t)(value_start - self->message);
+                header->value.length = value.length;
+                header->id = id;
+            }
+            else if (self->on_header_id)
+            {
+                self->on_header_id(id, key, value, self->callback_data);
+                if (self->halted)
+                    return -1;
+            }
+            else if (self->on_header)
+            {
+                self->on_header(key, value, self->callback_data);
+                if (self->halted)
+                    return -1;
+            }
+
+            self->buffer.start = newline + 1;
+        }
+    }
+
+    if (self->state == 4)
+    {
+        if (self->paused)
+            return 0;
+
+        if (self->content_length == -3)
+        {
+            self->state = 7;
+            self->tmp[3] = self->buffer.start; // end of the joined chunks
+        }
+        else if (self->content_length < -1)
+            self->state = 5;
+        else
+        {
+            int len = self->buffer.size - self->buffer.start;
+
+            if (self->target)
+            {
+                // only a content-length body gets a target
+                if (len > self->content_length - self->body_read)
+                    len = self->content_length - self->body_read;
+
+                if (len > 0)
+                    memcpy(self->target + self->body_read, self->buffer.data + self->buffer.start, len);
+                self->body_read += len;
+                self->buffer.start += len;
+                if (self->body_read == self->content_length)
+                {
+                    self->target = NULL;
+                    self->state = 5;
+                }
+                else
+                {
+                    self->buffer.start = 0;
+                    self->buffer.size = 0;
+                    self->scanned = 0;
+                }
+            }
+            else if (self->on_complete_content)
+            {
+                // the whole body has to be held, so refuse one
+                // that is too big as soon as that is known
+                if (self->max_body > 0 && (self->content_length > self->max_body || (self->content_length == -1 && len > self->max_body)))
+                    return -1;
+                if (self->content_length > INT_MAX)
+                    return -1;
+
+                if (self->content_length >= 0 && self->content_length <= len)
+                {
+                    self->state = 5;
+                    evhttp_string_t content;
+                    content.data = self->buffer.data + self->buffer.start;
+                    content.length = self->content_length;
+                    self->buffer.start += self->content_length;
+                    self->on_complete_content(content, self->callback_data);
+                    if (self->halted)
+                        return -1;
+                }
+            }
+            else
+            {
+                // anything past the content-length
+                // belongs to the next message
+                if (self->content_length >= 0 && len > self->content_length - self->body_read)
+                    len = self->content_length - self->body_read;
+
+                if (self->on_chunk && len > 0)
+                {
+                    evhttp_string_t content;
+                    content.data = self->buffer.data + self->buffer.start;
+                    content.length = len;
+                    self->on_chunk(content, self->callback_data);
+                    if (self->halted)
+                        return -1;
+                }
+
+                self->body_read += len;
+                self->buffer.start += len;
+                if (self->content_length >= 0 && self->content_length <= self->body_read)
+                    self->state = 5;
+                else
+                {
+                    self->buffer.start = 0;
+                    self->buffer.size = 0;
+                    self->scanned = 0;
+                }
+            }
+        }
+    }
+
+    // chunked content, 7 is the size line, 8 the
+    // data, 9 the line end after the data and 10
+    // the trailers after the last chunk
+    while (self->state >= 7)
+    {
+        char *data = self->buffer.data;
+
+        if (self->paused)
+            break;
+
+        if (self->state == 7)
+        {
+            int newline = buffer_find_chr(&self->buffer, &self->scanned, '\n');
+            if (newline < 0)
+                break;
+
+            int64_t size = parse_hex(data + self->buffer.start, newline - self->buffer.start);
+            if (size < 0)
+                return -1; // not chunked after all
+
+            self->buffer.start = newline + 1;
+            self->chunk_left = size;
+            self->state = size ? 8 : 10;
+        }
+        else if (self->state == 8)
+        {
+            int len = self->buffer.size - self->buffer.start;
+            if (len > self->chunk_left)
+                len = self->chunk_left;
+            if (len == 0)
+                break;
+
+            if (self->on_complete_content)
+            {
+                if (self->max_body > 0 && self->body_read + len > self->max_body)
+                    return -1;
+
+                // join the chunks up in place
+                if (self->tmp[3] != self->buffer.start)
+                    memmove(data + self->tmp[3], data + self->buffer.start, len);
+                self->tmp[3] += len;
+            }
+            else if (self->on_chunk)
+            {
+                evhttp_string_t content;
+                content.data = data + self->buffer.start;
+                content.length = len;
+                self->on_chunk(content, self->callback_data);
+                if (self->halted)
+                    return -1;
+            }
+
+            self->body_read += len;
+            self->chunk_left -= len;
+            self->buffer.start += len;
+            if (self->chunk_left == 0)
+                self->state = 9;
+        }
+        else if (self->state == 9)
+        {
+            int newline = buffer_find_chr(&self->buffer, &self->scanned, '\n');
+            if (newline < 0)
+                break;
+
+            self->buffer.start = newline + 1;
+            self->state = 7;
+        }
+        else
+        {
+            int newline = buffer_find_chr(&self->buffer, &self->scanned, '\n');
+            if (newline < 0)
+                break;
+
+            int start = self->buffer.start;
+            self->buffer.start = newline + 1;
+
+            // trailers are skipped, a blank line ends the message
+            if (newline == start || (newline == start + 1 && data[start] == '\r'))
+            {
+                self->state = 5;
+
+                if (self->on_complete_content)
+                {
+                    evhttp_string_t content;
+                    content.data = data + self->tmp[3] - self->body_read;
+                    content.length = self->body_read;
+                    self->on_complete_content(content, self->callback_data);
+                    if (self->halted)
+                        return -1;
+                }
+            }
+        }
+    }
+
+    if (self->state >= 7 && !self->on_complete_content)
+    {
+        // only a partial chunk line needs keeping
+        self->scanned -= self->buffer.start;
+        evhttp_buffer_compact(&self->buffer);
+    }
+
+    if (self->state == 5)
+    {
+        if (self->paused)
+            return 0;
+
+        // without keep alive go to terminal state 6
+        self->state = self->keep_alive ? 0 : 6;
+
+        if (self->timing)
+            self->times.complete = now();
+        if (self->on_complete)
+        {
+            self->on_complete(self->callback_data);
+            if (self->halted)
+                return -1;
+        }
+        memset(&self->times, 0, sizeof(self->times));
+
+        // a 1xx reply comes before the real
+        // one, so does not count
+        if (self->tmp[1] < 100 || self->tmp[1] >= 200)
+            ++self->messages;
+
+        if (self->state == 0)
+        {
+            // the next message starts with whatever is left
+            self->content_length = -2;
+            if (self->buffer.start < self->buffer.size)
+                return 1;
+
+            self->buffer.start = 0;
+            self->buffer.size = 0;
+            self->scanned = 0;
+        }
+    }
+
+    if (self->state == 6)
+    {
+        // terminal state, just absorb
+        // any further data
+        self->buffer.start = 0;
+        self->buffer.size = 0;
+        self->scanned = 0;
+    }
+
+    return 0;
+}
+
+void evhttp_parser_init(evhttp_parser_t *self,
+                        evhttp_connection_on_first_line on_first_line,
+                        evhttp_connection_on_header on_header,
+                        evhttp_connection_on_headers_end on_headers_end,
+                        evhttp_connection_on_content on_chunk,
+                        evhttp_connection_on_content on_complete_content,
+                        evhttp_connection_on_complete on_complete,
+                        void *callback_data)
+{
+    evhttp_buffer_init(&self->buffer);
+
+    self->state = 0;
+    self->scanned = 0;
+    self->message = 0;
+    self->content_length = -2;
+    self->keep_alive = 0;
+    self->messages = 0;
+    self->halted = 0;
+    self->paused = 0;
+    self->max_body = 0;
+    self->body_read = 0;
+    self->chunk_left = 0;
+    self->target = NULL;
+    self->timing = 0;
+    memset(&self->times, 0, sizeof(self->times));
+
+    self->on_first_line = on_first_line;
+    self->on_header = on_header;
+    self->on_header_id = NULL;
+    self->on_headers = NULL;
+    self->on_body_target = NULL;
+    self->headers = NULL;
+    self->max_headers = 0;
+    self->header_count = 0;
+    self->on_headers_end = on_headers_end;
+    self->on_chunk = on_chunk;
+    self->on_complete_content = on_complete_content;
+    self->on_complete = on_complete;
+    self->callback_data = callback_data;
+}
+
+void evhttp_parser_set_on_header_id(evhttp_parser_t *self, evhttp_connection_on_header_id on_header_id)
+{
+    self->on_header_id = on_header_id;
+}
+
+void evhttp_parser_set_on_headers(evhttp_parser_t *self, evhttp_header_t *headers, int max_headers, evhttp_connection_on_headers on_headers)
+{
+    self->headers = headers;
+    self->max_headers = max_headers;
+    self->on_headers = on_headers;
+}
+
+void evhttp_parser_set_on_body_target(evhttp_parser_t *self, evhttp_connection_on_body_target on_body_target)
+{
+    self->on_body_target = on_body_target;
+}
+
+void evhttp_parser_free(evhttp_parser_t *self)
+{
+    evhttp_buffer_free(&self->buffer);
+}
+
+int evhttp_parser_feed(evhttp_parser_t *self, const char *data, int length)
+{
+    char *space = evhttp_parser_reserve(self, length);
+    if (!space)
+        return -1;
+
+    memcpy(space, data, length);
+    return evhttp_parser_commit(self, length);
+}
+
+int evhttp_parser_feed_in_place(evhttp_parser_t *self, char *data, int length)
+{
+    buffer_t kept, in_place;
+    int rc, keep, left;
+
+    if (self->halted)
+        return -1;
+
+    // the new data has to follow on from what is kept
+    if (keep_from(self) < self->buffer.size)
+    {
+        rc = evhttp_parser_feed(self, data, length);
+        if (rc == 0 && keep_from(self) == self->buffer.size)
+        {
+            rebase(self, self->buffer.size);
+            evhttp_buffer_free(&self->buffer);
+        }
+        return rc;
+    }
+
+    rebase(self, self->buffer.size);
+    kept = self->buffer;
+    self->buffer.data = data;
+    self->buffer.start = 0;
+    self->buffer.size = length;
+    self->buffer.allocated = length;
+
+    while ((rc = parse(self)) > 0)
+        ;
+
+    in_place = self->buffer;
+    self->buffer = kept;
+    if (rc < 0)
+        return rc;
+
+    // only copy what the next data has to be joined to
+    keep = keep_from(self);
+    left = in_place.size - keep;
+    if (left > 0)
+    {
+        if (make_space(self, left) != 0)
+            return -1;
+        memcpy(self->buffer.data, in_place.data + keep, left);
+    }
+    else
+        evhttp_buffer_free(&self->buffer);
+
+    self->buffer.start = in_place.start;
+    self->buffer.size = in_place.size;
+    rebase(self, keep);
+    return 0;
+}
+
+char *evhttp_parser_reserve(evhttp_parser_t *self, int length)
+{
+    if (make_space(self, length) != 0)
+        return NULL;
+
+    return self->buffer.data + self->buffer.size;
+}
+
+char *evhttp_parser_target_space(evhttp_parser_t *self, int64_t *length)
+{
+    // bytes already in the buffer have to be copied in first
+    if (self->state != 4 || !self->target || self->paused || self->buffer.start < self->buffer.size)
+        return NULL;
+
+    *length = self->content_length - self->body_read;
+    return self->target + self->body_read;
+}
+
+int evhttp_parser_commit_target(evhttp_parser_t *self, int length)
+{
+    int rc;
+
+    if (self->halted)
+        return -1;
+
+    self->body_read += length;
+    if (self->body_read < self->content_length)
+        return 0;
+
+    self->target = NULL;
+    self->state = 5;
+    while ((rc = parse(self)) > 0)
+        ;
+    return rc;
+}
+
+int evhttp_parser_commit(evhttp_parser_t *self, int length)
+{
+    int rc;
+
+    if (self->halted)
+        return -1;
+
+    self->buffer.size += length;
+
+    // one read can hold the end of one
+    // message and the start of the next
+    while ((rc = parse(self)) > 0)
+        ;
+    return rc;
+}
+
+void evhttp_parser_pause(evhttp_parser_t *self)
+{
+    self->paused = 1;
+}
+
+int evhttp_parser_resume(evhttp_parser_t *self)
+{
+    self->paused = 0;
+    return evhttp_parser_commit(self, 0);
+}
+
+int evhttp_parser_paused(evhttp_parser_t *self)
+{
+    return self->paused;
+}
+
+void evhttp_parser_set_max_body(evhttp_parser_t *self, int64_t max_body)
+{
+    self->max_body = max_body;
+}
+
+void evhttp_parser_set_timing(evhttp_parser_t *self, int timing)
+{
+    self->timing = timing;
+}
+
+const evhttp_timing_t *evhttp_parser_timing(evhttp_parser_t *self)
+{
+    return self->timing ? &self->times : NULL;
+}
+
+int evhttp_parser_finish(evhttp_parser_t *self)
+{
+    if (self->halted)
+        return -1;
+
+    if (self->state == 4)
+    {
+        self->target = NULL;
+        if (self->content_length == -1 && self->on_complete_content)
+        {
+            // the close marks the end of the content
+            evhttp_string_t content;
+            content.data = self->buffer.data + self->buffer.start;
+            content.length = self->buffer.size - self->buffer.start;
+            self->on_complete_content(content, self->callback_data);
+            if (self->halted)
+                return -1;
+        }
+
+        self->state = 6;
+        if (self->timing)
+            self->times.complete = now();
+        if (self->on_complete)
+        {
+            self->on_complete(self->callback_data);
+            if (self->halted)
+                return -1;
+        }
+        memset(&self->times, 0, sizeof(self->times));
+        ++self->messages;
+    }
+
+    return 0;
+}
+
+void evhttp_parser_halt(evhttp_parser_t *self)
+{
+    self->halted = 1;
+}
+
+int evhttp_parser_keep_alive(evhttp_parser_t *self)
+{
+    return self->keep_alive;
+}
+
+int evhttp_parser_messages(evhttp_parser_t *self)
+{
+    return self->messages;
+}
+
+int evhttp_parser_phase(evhttp_parser_t *self)
+{
+    if (self->state == 0)
+        return self->buffer.start < self->buffer.size ? EVHTTP_PARSER_HEAD : EVHTTP_PARSER_IDLE;
+    if (self->state <= 3)
+        return EVHTTP_PARSER_HEAD;
+    if (self->state == 6)
+        return EVHTTP_PARSER_CLOSED;
+    return EVHTTP_PARSER_BODY;
+}
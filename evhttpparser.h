@@ -0,0 +1,177 @@
+#ifndef EVHTTPPARSER_H
+#define EVHTTPPARSER_H
+
+#include <stdint.h>
+
+#include "evhttpheaders.h"
+
+// Callback singatures
+
+typedef struct
+{
+    const char *data;
+    int length;
+} evhttp_string_t;
+
+typedef void (*evhttp_connection_on_first_line)(evhttp_string_t first, evhttp_string_t second, evhttp_string_t third, void *data);
+typedef void (*evhttp_connection_on_header)(evhttp_string_t key, evhttp_string_t value, void *data);
+// As on_header with the id of a known key, EVHTTP_HEADER_OTHER for the rest
+typedef void (*evhttp_connection_on_header_id)(evhttp_header_id_t id, evhttp_string_t key, evhttp_string_t value, void *data);
+typedef void (*evhttp_connection_on_headers_end)(evhttp_string_t message, void *data);
+
+// A header for on_headers, id is EVHTTP_HEADER_OTHER for unknown keys
+typedef struct
+{
+    evhttp_string_t key;
+    evhttp_string_t value;
+    evhttp_header_id_t id;
+} evhttp_header_t;
+
+// All of a message's headers at once, with the raw head as
+// on_headers_end gets it
+typedef void (*evhttp_connection_on_headers)(const evhttp_header_t *headers, int count, evhttp_string_t message, void *data);
+typedef void (*evhttp_connection_on_content)(evhttp_string_t content, void *data);
+typedef void (*evhttp_connection_on_complete)(void *data);
+// Somewhere to put a body of length bytes, or NULL to have it
+// delivered as usual
+typedef char *(*evhttp_connection_on_body_target)(int64_t length, void *data);
+typedef void (*evhttp_connection_on_close)(void *data);
+
+// A parser for a stream of HTTP messages, it knows nothing about
+// where the bytes come from so can sit behind any transport
+
+typedef struct evhttp_parser evhttp_parser_t;
+
+void evhttp_parser_init(evhttp_parser_t *self,
+                        evhttp_connection_on_first_line on_first_line,
+                        evhttp_connection_on_header on_header,
+                        evhttp_connection_on_headers_end on_headers_end,
+                        evhttp_connection_on_content on_chunk,
+                        evhttp_connection_on_content on_complete_content,
+                        evhttp_connection_on_complete on_complete,
+                        void *callback_data);
+void evhttp_parser_free(evhttp_parser_t *self);
+// Have headers go to on_header_id in place of on_header
+void evhttp_parser_set_on_header_id(evhttp_parser_t *self, evhttp_connection_on_header_id on_header_id);
+// Collect headers into the caller's array, which must outlive the
+// parser, and hand them all to on_headers at the end of the head in
+// place of on_header or on_header_id. A message with more than
+// max_headers headers is treated as malformed.
+void evhttp_parser_set_on_headers(evhttp_parser_t *self, evhttp_header_t *headers, int max_headers, evhttp_connection_on_headers on_headers);
+// Ask on_body_target at the end of each head with a content-length
+// for memory to put the body in, which then goes there and to neither
+// on_chunk nor on_complete_content. A body that on_complete_content
+// has to hold in one piece must be under 2GB, bigger ones need
+// on_chunk or a target.
+void evhttp_parser_set_on_body_target(evhttp_parser_t *self, evhttp_connection_on_body_target on_body_target);
+
+// Parse the next length bytes of the stream, returns -1 if the
+// stream is malformed or a callback halted the parser
+int evhttp_parser_feed(evhttp_parser_t *self, const char *data, int length);
+// Parse the next length bytes where they are, so they can be in a
+// buffer shared with other parsers. The bytes may be changed and
+// only the part of a message that is needed later is copied, with
+// nothing at all held between complete messages.
+int evhttp_parser_feed_in_place(evhttp_parser_t *self, char *data, int length);
+// Space for the next length bytes, to fill and then pass to
+// evhttp_parser_commit instead of copying them in with feed
+char *evhttp_parser_reserve(evhttp_parser_t *self, int length);
+int evhttp_parser_commit(evhttp_parser_t *self, int length);
+// Where the rest of a body going to a target can be read straight
+// into, with length set to how much of it is still to come, or NULL
+// when there is no such body waiting on more bytes
+char *evhttp_parser_target_space(evhttp_parser_t *self, int64_t *length);
+// length bytes were read into the target space
+int evhttp_parser_commit_target(evhttp_parser_t *self, int length);
+// The stream has ended, which completes a message that runs
+// until the close
+int evhttp_parser_finish(evhttp_parser_t *self);
+// Stop parsing, for use from callbacks
+void evhttp_parser_halt(evhttp_parser_t *self);
+// Hold back callbacks from the next one on, keeping whatever is fed
+// in the meantime, until evhttp_parser_resume parses it. Resume is
+// not for use from this parser's own callbacks, and finish still
+// completes a message that runs until the close.
+void evhttp_parser_pause(evhttp_parser_t *self);
+int evhttp_parser_resume(evhttp_parser_t *self);
+int evhttp_parser_paused(evhttp_parser_t *self);
+// The largest body on_complete_content will hold, anything bigger
+// is treated as malformed, 0 for no limit
+void evhttp_parser_set_max_body(evhttp_parser_t *self, int64_t max_body);
+
+// Non zero if the stream continues after the current message
+int evhttp_parser_keep_alive(evhttp_parser_t *self);
+// The number of messages completed, not counting 1xx replies
+int evhttp_parser_messages(evhttp_parser_t *self);
+
+// Where in the stream the parser is
+#define EVHTTP_PARSER_IDLE 0 // between messages with nothing waiting
+#define EVHTTP_PARSER_HEAD 1 // part way through a first line or headers
+#define EVHTTP_PARSER_BODY 2
+#define EVHTTP_PARSER_CLOSED 3 // after a message that ends the stream
+int evhttp_parser_phase(evhttp_parser_t *self);
+
+// When the current message reached each point, in seconds on the
+// monotonic clock, 0 for points not reached yet
+typedef struct
+{
+    double first_byte; // parsed, after any blank lines
+    double first_line; // just before on_first_line
+    double headers_end; // just before on_headers or on_headers_end
+    double complete; // just before on_complete
+} evhttp_timing_t;
+
+// Record the timing of each message, off by default as it costs
+// a clock read per point
+void evhttp_parser_set_timing(evhttp_parser_t *self, int timing);
+// Valid from the first byte until on_complete returns, or NULL
+// with timing off
+const evhttp_timing_t *evhttp_parser_timing(evhttp_parser_t *self);
+
+// Internal structs, defined so evhttp_parser_t can be put on the stack
+
+typedef struct
+{
+    char *data;
+    int start;
+    int size;
+    int allocated;
+    struct evhttp_pool *pool;
+} evhttp_buffer_t;
+
+struct evhttp_parser
+{
+    evhttp_buffer_t buffer;
+
+    int state;
+    int scanned;
+    int message;
+    int64_t content_length;
+    int64_t body_read; // so far, or joined so far
+    int64_t chunk_left;
+    int tmp[4];
+    int keep_alive;
+    int messages;
+    int halted;
+    int paused;
+    int64_t max_body;
+    char *target;
+    evhttp_header_t *headers;
+    int max_headers;
+    int header_count;
+    int timing;
+    evhttp_timing_t times;
+
+    evhttp_connection_on_first_line on_first_line;
+    evhttp_connection_on_header on_header;
+    evhttp_connection_on_header_id on_header_id;
+    evhttp_connection_on_headers on_headers;
+    evhttp_connection_on_body_target on_body_target;
+    evhttp_connection_on_headers_end on_headers_end;
+    evhttp_connection_on_content on_chunk;
+    evhttp_connection_on_content on_complete_content;
+    evhttp_connection_on_complete on_complete;
+    void *callback_data;
+};
+
+#endif
@@ -0,0 +1,145 @@
+#include "evhttppool.h"
+
+#include <stdlib.h>
+
+typedef evhttp_pool_t pool_t;
+typedef evhttp_pool_class_t pool_class_t;
+
+#define PAGE_SIZE 4096
+
+// The class that fits size, or -1 if it is too big for any
+static int size_class(int size)
+{
+    int idx, class_size = EVHTTP_POOL_MIN_SIZE;
+    for (idx=0; idx<EVHTTP_POOL_CLASSES; ++idx, class_size<<=1)
+    {
+        if (size <= class_size)
+            return idx;
+    }
+    return -1;
+}
+
+static char *allocate(int size)
+{
+    void *data;
+    if (posix_memalign(&data, PAGE_SIZE, size) != 0)
+        return NULL;
+    return (char *)data;
+}
+
+void evhttp_pool_init(pool_t *self)
+{
+    int idx;
+    for (idx=0; idx<EVHTTP_POOL_CLASSES; ++idx)
+    {
+        pool_class_t *pool_class = self->classes + idx;
+        pool_class->free_list = NULL;
+        pool_class->free = 0;
+        pool_class->in_use = 0;
+        pool_class->low_water = 0;
+        pool_class->high_water = 0;
+    }
+    self->scratch = NULL;
+    self->scratch_size = 0;
+}
+
+void evhttp_pool_free(pool_t *self)
+{
+    int idx;
+    for (idx=0; idx<EVHTTP_POOL_CLASSES; ++idx)
+    {
+        pool_class_t *pool_class = self->classes + idx;
+        while (pool_class->free_list)
+        {
+            void *data = pool_class->free_list;
+            pool_class->free_list = *(void **)data;
+            free(data);
+        }
+    }
+    free(self->scratch);
+    evhttp_pool_init(self);
+}
+
+char *evhttp_pool_get(pool_t *self, int *size)
+{
+    int idx = size_class(*size);
+    if (idx < 0)
+    {
+        *size = (*size + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+        return allocate(*size);
+    }
+
+    pool_class_t *pool_class = self->classes + idx;
+    char *data;
+
+    *size = EVHTTP_POOL_MIN_SIZE << idx;
+    if (pool_class->free_list)
+    {
+        data = (char *)pool_class->free_list;
+        pool_class->free_list = *(void **)data;
+        if (--pool_class->free < pool_class->low_water)
+            pool_class->low_water = pool_class->free;
+    }
+    else
+    {
+        data = allocate(*size);
+        if (!data)
+            return NULL;
+    }
+
+    if (++pool_class->in_use > pool_class->high_water)
+        pool_class->high_water = pool_class->in_use;
+    return data;
+}
+
+void evhttp_pool_put(pool_t *self, char *data, int size)
+{
+    int idx = size_class(size);
+    if (idx < 0)
+    {
+        free(data);
+        return;
+    }
+
+    pool_class_t *pool_class = self->classes + idx;
+    *(void **)data = pool_class->free_list;
+    pool_class->free_list = data;
+    ++pool_class->free;
+    --pool_class->in_use;
+}
+
+void evhttp_pool_trim(pool_t *self)
+{
+    int idx;
+    for (idx=0; idx<EVHTTP_POOL_CLASSES; ++idx)
+    {
+        pool_class_t *pool_class = self->classes + idx;
+
+        // buffers that stayed free the whole time were not needed
+        while (pool_class->low_water > 0 && pool_class->free_list)
+        {
+            void *data = pool_class->free_list;
+            pool_class->free_list = *(void **)data;
+            free(data);
+            --pool_class->free;
+            --pool_class->low_water;
+        }
+
+        pool_class->low_water = pool_class->free;
+        pool_class->high_water = pool_class->in_use;
+    }
+}
+
+char *evhttp_pool_scratch(pool_t *self, int size)
+{
+    if (size > self->scratch_size)
+    {
+        // nothing in it needs keeping so no realloc
+        free(self->scratch);
+        self->scratch_size = (size + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+        self->scratch = allocate(self->scratch_size);
+        if (!self->scratch)
+            self->scratch_size = 0;
+    }
+    return self->scratch;
+}
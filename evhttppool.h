@@ -0,0 +1,48 @@
+#ifndef EVHTTPPOOL_H
+#define EVHTTPPOOL_H
+
+// A pool of page aligned buffers in power of two size classes, so
+// connections coming and going reuse the same memory rather than
+// going back to malloc each time. It is not thread safe, use one per
+// loop and call evhttp_pool_trim every few seconds from a timer to
+// hand back what has not been needed since the last trim.
+
+#define EVHTTP_POOL_MIN_SIZE 4096
+// 4K up to 256K, anything bigger goes straight to the system
+#define EVHTTP_POOL_CLASSES 7
+
+typedef struct evhttp_pool evhttp_pool_t;
+
+void evhttp_pool_init(evhttp_pool_t *self);
+// Give back the free buffers, everything taken must have been put back
+void evhttp_pool_free(evhttp_pool_t *self);
+
+// A buffer of at least *size bytes, *size is set to its real size
+char *evhttp_pool_get(evhttp_pool_t *self, int *size);
+void evhttp_pool_put(evhttp_pool_t *self, char *data, int size);
+// Release the free buffers that went unused since the last trim
+void evhttp_pool_trim(evhttp_pool_t *self);
+// One buffer of at least size bytes shared by everything on the loop,
+// good until the next call
+char *evhttp_pool_scratch(evhttp_pool_t *self, int size);
+
+// Internal structs, defined so evhttp_pool_t can be put on the stack
+
+typedef struct
+{
+    void *free_list;
+    int free;
+    int in_use;
+    // lowest free and highest in use since the last trim
+    int low_water;
+    int high_water;
+} evhttp_pool_class_t;
+
+struct evhttp_pool
+{
+    evhttp_pool_class_t classes[EVHTTP_POOL_CLASSES];
+    char *scratch;
+    int scratch_size;
+};
+
+#endif
@@ -0,0 +1,233 @@
+#include "evhttpscan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+///
+// Scalar, one byte at a time
+///
+
+static int scalar_find_chr(const char *data, int start, int end, char c)
+{
+    int i;
+    for (i=start; i<end; ++i)
+    {
+        if (data[i] == c)
+            return i;
+    }
+    return -1;
+}
+
+static int scalar_find_key_end(char *data, int start, int end)
+{
+    int i;
+    for (i=start; i<end; ++i)
+    {
+        char c = data[i];
+        if (c == ':' || c == ' ' || c == '\t')
+            break;
+        if (c >= 'A' && c <= 'Z')
+            data[i] = c + ('a' - 'A');
+    }
+    return i;
+}
+
+static int scalar_skip_space(const char *data, int start, int end)
+{
+    int i;
+    for (i=start; i<end; ++i)
+    {
+        char c = data[i];
+        if (c != ' ' && c != '\t')
+            break;
+    }
+    return i;
+}
+
+const evhttp_scanner_t evhttp_scanner_scalar =
+{
+    "scalar",
+    scalar_find_chr,
+    scalar_find_key_end,
+    scalar_skip_space,
+};
+
+#if defined(__x86_64__) || defined(__i386__)
+
+// The first n bytes of (prefix + 32 - n) are set
+static const char prefix[64] =
+{
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+};
+
+///
+// SSE2, 16 bytes at a time
+///
+
+__attribute__((target("sse2")))
+static int sse2_find_chr(const char *data, int start, int end, char c)
+{
+    const __m128i needle = _mm_set1_epi8(c);
+    int i = start;
+    for (; i+16<=end; i+=16)
+    {
+        __m128i block = _mm_loadu_si128((const __m128i *)(data + i));
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, needle));
+        if (mask)
+            return i + __builtin_ctz(mask);
+    }
+    return scalar_find_chr(data, i, end, c);
+}
+
+__attribute__((target("sse2")))
+static int sse2_find_key_end(char *data, int start, int end)
+{
+    const __m128i colon = _mm_set1_epi8(':');
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    // 'A' lands on -128 so upper case is anything below -102
+    const __m128i shift = _mm_set1_epi8((char)(0x80 - 'A'));
+    const __m128i upper = _mm_set1_epi8(-128 + 26);
+    const __m128i bit = _mm_set1_epi8(0x20);
+    int i = start;
+    for (; i+16<=end; i+=16)
+    {
+        __m128i block = _mm_loadu_si128((const __m128i *)(data + i));
+        __m128i stop = _mm_or_si128(_mm_cmpeq_epi8(block, colon),
+                                    _mm_or_si128(_mm_cmpeq_epi8(block, space), _mm_cmpeq_epi8(block, tab)));
+        int mask = _mm_movemask_epi8(stop);
+        int length = mask ? __builtin_ctz(mask) : 16;
+
+        __m128i is_upper = _mm_cmplt_epi8(_mm_add_epi8(block, shift), upper);
+        is_upper = _mm_and_si128(is_upper, _mm_loadu_si128((const __m128i *)(prefix + 32 - length)));
+        if (_mm_movemask_epi8(is_upper))
+            _mm_storeu_si128((__m128i *)(data + i), _mm_or_si128(block, _mm_and_si128(is_upper, bit)));
+
+        if (mask)
+            return i + length;
+    }
+    return scalar_find_key_end(data, i, end);
+}
+
+__attribute__((target("sse2")))
+static int sse2_skip_space(const char *data, int start, int end)
+{
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    int i = start;
+    // runs are usually short, so look at the first byte alone
+    if (i < end && data[i] != ' ' && data[i] != '\t')
+        return i;
+    for (; i+16<=end; i+=16)
+    {
+        __m128i block = _mm_loadu_si128((const __m128i *)(data + i));
+        int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(block, space), _mm_cmpeq_epi8(block, tab)));
+        if (mask != 0xffff)
+            return i + __builtin_ctz(~mask);
+    }
+    return scalar_skip_space(data, i, end);
+}
+
+const evhttp_scanner_t evhttp_scanner_sse2 =
+{
+    "sse2",
+    sse2_find_chr,
+    sse2_find_key_end,
+    sse2_skip_space,
+};
+
+///
+// AVX2, 32 bytes at a time
+///
+
+__attribute__((target("avx2")))
+static int avx2_find_chr(const char *data, int start, int end, char c)
+{
+    const __m256i needle = _mm256_set1_epi8(c);
+    int i = start;
+    for (; i+32<=end; i+=32)
+    {
+        __m256i block = _mm256_loadu_si256((const __m256i *)(data + i));
+        unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, needle));
+        if (mask)
+            return i + __builtin_ctz(mask);
+    }
+    return sse2_find_chr(data, i, end, c);
+}
+
+__attribute__((target("avx2")))
+static int avx2_find_key_end(char *data, int start, int end)
+{
+    const __m256i colon = _mm256_set1_epi8(':');
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i shift = _mm256_set1_epi8((char)(0x80 - 'A'));
+    const __m256i upper = _mm256_set1_epi8(-128 + 26);
+    const __m256i bit = _mm256_set1_epi8(0x20);
+    int i = start;
+    for (; i+32<=end; i+=32)
+    {
+        __m256i block = _mm256_loadu_si256((const __m256i *)(data + i));
+        __m256i stop = _mm256_or_si256(_mm256_cmpeq_epi8(block, colon),
+                                       _mm256_or_si256(_mm256_cmpeq_epi8(block, space), _mm256_cmpeq_epi8(block, tab)));
+        unsigned mask = _mm256_movemask_epi8(stop);
+        int length = mask ? __builtin_ctz(mask) : 32;
+
+        __m256i is_upper = _mm256_cmpgt_epi8(upper, _mm256_add_epi8(block, shift));
+        is_upper = _mm256_and_si256(is_upper, _mm256_loadu_si256((const __m256i *)(prefix + 32 - length)));
+        if (_mm256_movemask_epi8(is_upper))
+            _mm256_storeu_si256((__m256i *)(data + i), _mm256_or_si256(block, _mm256_and_si256(is_upper, bit)));
+
+        if (mask)
+            return i + length;
+    }
+    return sse2_find_key_end(data, i, end);
+}
+
+__attribute__((target("avx2")))
+static int avx2_skip_space(const char *data, int start, int end)
+{
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i tab = _mm256_set1_epi8('\t');
+    int i = start;
+    if (i < end && data[i] != ' ' && data[i] != '\t')
+        return i;
+    for (; i+32<=end; i+=32)
+    {
+        __m256i block = _mm256_loadu_si256((const __m256i *)(data + i));
+        unsigned mask = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(block, space), _mm256_cmpeq_epi8(block, tab)));
+        if (mask != 0xffffffff)
+            return i + __builtin_ctz(~mask);
+    }
+    return sse2_skip_space(data, i, end);
+}
+
+const evhttp_scanner_t evhttp_scanner_avx2 =
+{
+    "avx2",
+    avx2_find_chr,
+    avx2_find_key_end,
+    avx2_skip_space,
+};
+
+#endif
+
+///
+// Selection
+///
+
+const evhttp_scanner_t *evhttp_scanner = &evhttp_scanner_scalar;
+
+__attribute__((constructor))
+static void select_scanner(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        evhttp_scanner = &evhttp_scanner_avx2;
+    else if (__builtin_cpu_supports("sse2"))
+        evhttp_scanner = &evhttp_scanner_sse2;
+#endif
+}
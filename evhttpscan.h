@@ -0,0 +1,27 @@
+// Delimiter scanning used by the parser, the best implementation
+// for the CPU is picked when the library is loaded
+
+typedef struct
+{
+    const char *name;
+
+    // Index of the first c in data[start, end) or -1
+    int (*find_chr)(const char *data, int start, int end, char c);
+
+    // Index of the first ':', ' ' or '\t' in data[start, end) or
+    // end, lowercasing everything before it
+    int (*find_key_end)(char *data, int start, int end);
+
+    // Index of the first byte in data[start, end) that is not
+    // ' ' or '\t', or end
+    int (*skip_space)(const char *data, int start, int end);
+} evhttp_scanner_t;
+
+extern const evhttp_scanner_t evhttp_scanner_scalar;
+#if defined(__x86_64__) || defined(__i386__)
+extern const evhttp_scanner_t evhttp_scanner_sse2;
+extern const evhttp_scanner_t evhttp_scanner_avx2;
+#endif
+
+// The one to use
+extern const evhttp_scanner_t *evhttp_scanner;
@@ -0,0 +1,410 @@
+#define _GNU_SOURCE
+#include "evhttpserver.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sched.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+typedef evhttp_server_t server_t;
+typedef evhttp_server_thread_t thread_t;
+typedef evhttp_server_connection_t server_connection_t;
+typedef evhttp_server_config_t config_t;
+typedef struct ev_loop ev_loop_t;
+
+// Most connections to take per wakeup
+#define ACCEPT_BATCH 64
+// How often the buffer pools give back what they have not needed
+#define TRIM_INTERVAL 5.
+// How late a timeout can be
+#define TIMER_RESOLUTION 0.25
+
+///
+// Connections
+///
+
+static void on_close(void *data)
+{
+    server_connection_t *conn = (server_connection_t *)data;
+    thread_t *thread = conn->thread;
+
+    if (thread->server->config.on_close)
+        thread->server->config.on_close(conn);
+
+    close(conn->fd);
+    conn->fd = -1;
+    conn->next_free = thread->free_conns;
+    thread->free_conns = conn;
+    --thread->active;
+
+    // take more now there is room
+    if (thread->fd >= 0)
+        ev_io_start(thread->loop, &thread->accept_watcher);
+}
+
+static void on_accept(ev_loop_t *loop, ev_io *watcher, int revents)
+{
+    thread_t *thread = (thread_t *)watcher->data;
+    const config_t *config = &thread->server->config;
+    int count = 0, one = 1;
+
+    while (count < ACCEPT_BATCH)
+    {
+        if (!thread->free_conns)
+        {
+            // full, leave the rest in the backlog until one closes
+            ev_io_stop(loop, watcher);
+            return;
+        }
+
+        int fd = accept4(thread->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            // out of fds, wait for a close or the next
+            // trim rather than spin on the backlog
+            if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM)
+                ev_io_stop(loop, watcher);
+            return;
+        }
+        ++count;
+
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        server_connection_t *conn = thread->free_conns;
+        thread->free_conns = conn->next_free;
+        conn->next_free = NULL;
+        conn->fd = fd;
+        conn->data = NULL;
+        ++thread->active;
+        ++thread->accepted;
+
+        evhttp_connection_init_with_pool(&conn->http_conn,
+                                         loop,
+                                         &thread->pool,
+                                         fd,
+                                         config->on_first_line,
+                                         config->on_header,
+                                         config->on_headers_end,
+                                         config->on_chunk,
+                                         config->on_complete_content,
+                                         config->on_complete,
+                                         on_close,
+                                         conn);
+
+        if (config->on_header_id)
+            evhttp_connection_set_on_header_id(&conn->http_conn, config->on_header_id);
+        if (config->on_headers)
+            evhttp_connection_set_on_headers(&conn->http_conn, conn->headers, config->max_headers, config->on_headers);
+        if (config->on_body_target)
+            evhttp_connection_set_on_body_target(&conn->http_conn, config->on_body_target);
+        if (config->header_timeout > 0 || config->body_timeout > 0 ||
+            config->idle_timeout > 0 || config->write_timeout > 0)
+            evhttp_connection_use_timers(&conn->http_conn, &thread->timers);
+        if (thread->has_uring)
+            evhttp_connection_use_uring(&conn->http_conn, &thread->uring);
+
+        if (config->on_accept && config->on_accept(conn) != 0)
+            evhttp_connection_close(&conn->http_conn);
+    }
+}
+
+///
+// Threads
+///
+
+static void on_trim(ev_loop_t *loop, ev_timer *watcher, int revents)
+{
+    thread_t *thread = (thread_t *)watcher->data;
+    evhttp_pool_trim(&thread->pool);
+
+    // try again after running out of fds
+    if (thread->fd >= 0 && thread->free_conns)
+        ev_io_start(loop, &thread->accept_watcher);
+}
+
+static void on_stop(ev_loop_t *loop, ev_async *watcher, int revents)
+{
+    thread_t *thread = (thread_t *)watcher->data;
+    int idx;
+
+    ev_io_stop(loop, &thread->accept_watcher);
+    close(thread->fd);
+    thread->fd = -1;
+
+    for (idx=0; idx<thread->server->config.max_connections; ++idx)
+    {
+        if (thread->conns[idx].fd >= 0)
+            evhttp_connection_close(&thread->conns[idx].http_conn);
+    }
+
+    evhttp_timers_free(&thread->timers);
+    if (thread->has_uring)
+        evhttp_uring_free(&thread->uring);
+    ev_timer_stop(loop, &thread->trim_watcher);
+    ev_async_stop(loop, &thread->stop_watcher);
+    ev_break(loop, EVBREAK_ALL);
+}
+
+static void *thread_main(void *data)
+{
+    thread_t *thread = (thread_t *)data;
+
+    if (thread->server->config.pin_threads)
+    {
+        // the CPUs allowed need not start at 0 or be without gaps,
+        // under taskset or a cgroup say, so count through the mask
+        cpu_set_t allowed, cpus;
+        if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0 && CPU_COUNT(&allowed) > 0)
+        {
+            int nth = thread->index % CPU_COUNT(&allowed), cpu;
+            for (cpu=0; cpu<CPU_SETSIZE; ++cpu)
+            {
+                if (CPU_ISSET(cpu, &allowed) && nth-- == 0)
+                    break;
+            }
+            CPU_ZERO(&cpus);
+            CPU_SET(cpu, &cpus);
+            pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+        }
+    }
+
+    ev_run(thread->loop, 0);
+    return NULL;
+}
+
+// A listening socket of its own, the kernel balances
+// between sockets bound with SO_REUSEPORT
+static int listen_socket(const config_t *config)
+{
+    struct sockaddr_in addr;
+    int fd, one = 1;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(config->port);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (config->host && inet_pton(AF_INET, config->host, &addr.sin_addr) != 1)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) != 0 ||
+        setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) != 0 ||
+        bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        listen(fd, SOMAXCONN) != 0)
+    {
+        int error = errno;
+        close(fd);
+        errno = error;
+        return -1;
+    }
+    return fd;
+}
+
+static int thread_init(thread_t *thread, server_t *server, int index)
+{
+    int idx;
+
+    thread->server = server;
+    thread->index = index;
+    thread->active = 0;
+    thread->accepted = 0;
+
+    thread->fd = listen_socket(&server->config);
+    if (thread->fd < 0)
+        return -1;
+
+    // with port 0 the first socket gets one from the kernel and
+    // the rest join it there, rather than each getting their own
+    if (server->config.port == 0)
+    {
+        struct sockaddr_in addr;
+        socklen_t length = sizeof(addr);
+        if (getsockname(thread->fd, (struct sockaddr *)&addr, &length) != 0)
+        {
+            int error = errno;
+            close(thread->fd);
+            errno = error;
+            return -1;
+        }
+        server->config.port = ntohs(addr.sin_port);
+    }
+
+    thread->conns = (server_connection_t *)malloc(sizeof(server_connection_t) * server->config.max_connections);
+    if (!thread->conns)
+    {
+        close(thread->fd);
+        return -1;
+    }
+
+    // one block for every connection's headers
+    thread->headers = NULL;
+    if (server->config.on_headers)
+    {
+        thread->headers = (evhttp_header_t *)malloc(sizeof(evhttp_header_t) * server->config.max_headers * server->config.max_connections);
+        if (!thread->headers)
+        {
+            free(thread->conns);
+            close(thread->fd);
+            return -1;
+        }
+    }
+
+    thread->free_conns = NULL;
+    for (idx=server->config.max_connections-1; idx>=0; --idx)
+    {
+        thread->conns[idx].thread = thread;
+        thread->conns[idx].fd = -1;
+        thread->conns[idx].headers = thread->headers ? thread->headers + idx * server->config.max_headers : NULL;
+        thread->conns[idx].next_free = thread->free_conns;
+        thread->free_conns = thread->conns + idx;
+    }
+
+    thread->loop = ev_loop_new(EVFLAG_AUTO);
+    if (!thread->loop)
+    {
+        int error = errno;
+        free(thread->headers);
+        free(thread->conns);
+        close(thread->fd);
+        errno = error ? error : ENOMEM;
+        return -1;
+    }
+    evhttp_pool_init(&thread->pool);
+
+    // one wheel for all the thread's connections
+    evhttp_timers_init(&thread->timers, thread->loop, TIMER_RESOLUTION);
+    evhttp_timers_set_timeouts(&thread->timers,
+                               server->config.header_timeout,
+                               server->config.body_timeout,
+                               server->config.idle_timeout,
+                               server->config.write_timeout);
+
+    // without it the connections carry on with plain libev
+    thread->has_uring = server->config.use_uring && evhttp_uring_init(&thread->uring, thread->loop) == 0;
+
+    thread->accept_watcher.data = thread;
+    ev_io_init(&thread->accept_watcher, on_accept, thread->fd, EV_READ);
+    ev_io_start(thread->loop, &thread->accept_watcher);
+
+    thread->stop_watcher.data = thread;
+    ev_async_init(&thread->stop_watcher, on_stop);
+    ev_async_start(thread->loop, &thread->stop_watcher);
+
+    thread->trim_watcher.data = thread;
+    ev_timer_init(&thread->trim_watcher, on_trim, TRIM_INTERVAL, TRIM_INTERVAL);
+    ev_timer_start(thread->loop, &thread->trim_watcher);
+    return 0;
+}
+
+static void thread_free(thread_t *thread)
+{
+    evhttp_pool_free(&thread->pool);
+    ev_loop_destroy(thread->loop);
+    free(thread->conns);
+    free(thread->headers);
+}
+
+// Undo thread_init for a thread that never ran, one that
+// did let go of its socket, timers and ring in on_stop
+static void thread_discard(thread_t *thread)
+{
+    close(thread->fd);
+    evhttp_timers_free(&thread->timers);
+    if (thread->has_uring)
+        evhttp_uring_free(&thread->uring);
+    thread_free(thread);
+}
+
+///
+// Server
+///
+
+int evhttp_server_start(server_t *self, const config_t *config)
+{
+    int idx, started;
+
+    self->config = *config;
+    if (self->config.threads < 1)
+        self->config.threads = 1;
+    if (self->config.max_connections < 1)
+        self->config.max_connections = 1024;
+    if (self->config.max_headers < 1)
+        self->config.max_headers = 64;
+
+    self->threads = (thread_t *)calloc(self->config.threads, sizeof(thread_t));
+    if (!self->threads)
+        return -1;
+
+    // the sockets are all made up front so a bad
+    // port or address is reported here
+    for (idx=0; idx<self->config.threads; ++idx)
+    {
+        if (thread_init(self->threads + idx, self, idx) != 0)
+        {
+            int error = errno;
+            while (idx-- > 0)
+                thread_discard(self->threads + idx);
+            free(self->threads);
+            errno = error;
+            return -1;
+        }
+    }
+
+    for (started=0; started<self->config.threads; ++started)
+    {
+        if (pthread_create(&self->threads[started].thread, NULL, thread_main, self->threads + started) != 0)
+            break;
+    }
+
+    if (started < self->config.threads)
+    {
+        // stop the ones that did start and tidy up the rest
+        for (idx=0; idx<started; ++idx)
+            ev_async_send(self->threads[idx].loop, &self->threads[idx].stop_watcher);
+        for (idx=0; idx<self->config.threads; ++idx)
+        {
+            if (idx < started)
+            {
+                pthread_join(self->threads[idx].thread, NULL);
+                thread_free(self->threads + idx);
+            }
+            else
+                thread_discard(self->threads + idx);
+        }
+        free(self->threads);
+        errno = EAGAIN;
+        return -1;
+    }
+
+    return 0;
+}
+
+void evhttp_server_stop(server_t *self)
+{
+    int idx;
+
+    for (idx=0; idx<self->config.threads; ++idx)
+        ev_async_send(self->threads[idx].loop, &self->threads[idx].stop_watcher);
+
+    for (idx=0; idx<self->config.threads; ++idx)
+    {
+        pthread_join(self->threads[idx].thread, NULL);
+        thread_free(self->threads + idx);
+    }
+
+    free(self->threads);
+    self->threads = NULL;
+}
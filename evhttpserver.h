@@ -0,0 +1,99 @@
+#ifndef EVHTTPSERVER_H
+#define EVHTTPSERVER_H
+
+#include <pthread.h>
+
+#include "evhttpconn.h"
+
+// A server that runs one loop per thread, each with its own
+// SO_REUSEPORT listening socket so the kernel spreads connections
+// across them without a shared accept lock. Every connection comes
+// from a fixed set per thread and takes its buffers from the
+// thread's pool.
+
+typedef struct evhttp_server evhttp_server_t;
+typedef struct evhttp_server_thread evhttp_server_thread_t;
+typedef struct evhttp_server_connection evhttp_server_connection_t;
+
+// The connection callbacks all get the evhttp_server_connection_t
+// as their data
+typedef struct
+{
+    const char *host; // NULL for any
+    int port; // 0 for one the kernel picks, found in the server's config once started
+    int threads;
+    int max_connections; // per thread
+    int pin_threads; // non zero to pin thread n to the nth CPU the process may use
+    // in seconds, 0 for none, see evhttp_connection_use_timers
+    double header_timeout;
+    double body_timeout;
+    double idle_timeout;
+    double write_timeout;
+    // non zero to read and write through io_uring,
+    // where the kernel has it, see evhttp_connection_use_uring
+    int use_uring;
+
+    evhttp_connection_on_first_line on_first_line;
+    evhttp_connection_on_header on_header;
+    evhttp_connection_on_header_id on_header_id; // in place of on_header if set
+    evhttp_connection_on_headers on_headers; // in place of either if set
+    int max_headers; // per message, for on_headers
+    evhttp_connection_on_body_target on_body_target;
+    evhttp_connection_on_headers_end on_headers_end;
+    evhttp_connection_on_content on_chunk;
+    evhttp_connection_on_content on_complete_content;
+    evhttp_connection_on_complete on_complete;
+    evhttp_connection_on_close on_close;
+    // A new connection is ready, return non zero to close it
+    int (*on_accept)(evhttp_server_connection_t *conn);
+
+    void *data;
+} evhttp_server_config_t;
+
+// Returns -1 with errno set if the sockets or threads could not be made
+int evhttp_server_start(evhttp_server_t *self, const evhttp_server_config_t *config);
+// Close everything and wait for the threads to finish
+void evhttp_server_stop(evhttp_server_t *self);
+
+// Internal structs, defined so evhttp_server_t can be put on the stack
+
+struct evhttp_server_connection
+{
+    evhttp_connection_t http_conn;
+    evhttp_server_thread_t *thread;
+    int fd;
+    evhttp_header_t *headers; // for on_headers
+    // for the caller
+    void *data;
+    evhttp_server_connection_t *next_free;
+};
+
+struct evhttp_server_thread
+{
+    evhttp_server_t *server;
+    int index;
+    pthread_t thread;
+    struct ev_loop *loop;
+    evhttp_pool_t pool;
+    evhttp_timers_t timers;
+    evhttp_uring_t uring;
+    int has_uring;
+    int fd;
+    struct ev_io accept_watcher;
+    struct ev_async stop_watcher;
+    struct ev_timer trim_watcher;
+
+    evhttp_server_connection_t *conns;
+    evhttp_header_t *headers;
+    evhttp_server_connection_t *free_conns;
+    int active;
+    long accepted;
+};
+
+struct evhttp_server
+{
+    evhttp_server_config_t config;
+    evhttp_server_thread_t *threads;
+};
+
+#endif
@@ -0,0 +1,153 @@
+#include "evhttptimer.h"
+
+typedef evhttp_timers_t timers_t;
+typedef struct ev_loop ev_loop_t;
+
+static void on_tick(ev_loop_t *loop, ev_timer *watcher, int revents);
+
+///
+// Lists
+///
+
+static void list_init(evhttp_timer_t *head)
+{
+    head->next = head;
+    head->prev = head;
+}
+
+static void list_push(evhttp_timer_t *head, evhttp_timer_t *timer)
+{
+    timer->prev = head->prev;
+    timer->next = head;
+    head->prev->next = timer;
+    head->prev = timer;
+}
+
+///
+// Timers
+///
+
+// The tick the loop's time is in, which the wheel's own now can be
+// behind after a stall or while nothing is ticking it, but never
+// before now should the clock be set back
+static unsigned long current_tick(timers_t *self)
+{
+    double elapsed = ev_now(self->loop) - self->started;
+    unsigned long tick = elapsed > 0 ? (unsigned long)(elapsed / self->resolution) : 0;
+    return tick > self->now ? tick : self->now;
+}
+
+void evhttp_timers_init(timers_t *self, struct ev_loop *loop, double resolution)
+{
+    int idx;
+
+    self->loop = loop;
+    self->resolution = resolution > 0 ? resolution : 1.;
+    self->started = ev_now(loop);
+    self->now = 0;
+
+    self->header_timeout = 0;
+    self->body_timeout = 0;
+    self->idle_timeout = 0;
+    self->write_timeout = 0;
+
+    for (idx=0; idx<EVHTTP_TIMER_SLOTS; ++idx)
+        list_init(self->slots + idx);
+
+    self->tick_watcher.data = self;
+    ev_timer_init(&self->tick_watcher, on_tick, self->resolution, self->resolution);
+    ev_timer_start(loop, &self->tick_watcher);
+    // the wheel alone should not keep the loop going
+    ev_unref(loop);
+}
+
+void evhttp_timers_free(timers_t *self)
+{
+    int idx;
+
+    ev_ref(self->loop);
+    ev_timer_stop(self->loop, &self->tick_watcher);
+
+    // leave any timers still set unlinked
+    for (idx=0; idx<EVHTTP_TIMER_SLOTS; ++idx)
+    {
+        evhttp_timer_t *head = self->slots + idx;
+        while (head->next != head)
+            evhttp_timer_cancel(head->next);
+    }
+}
+
+void evhttp_timers_set_timeouts(timers_t *self, double header, double body, double idle, double write)
+{
+    self->header_timeout = header;
+    self->body_timeout = body;
+    self->idle_timeout = idle;
+    self->write_timeout = write;
+}
+
+void evhttp_timer_init(evhttp_timer_t *timer, evhttp_timer_on_expire on_expire)
+{
+    timer->next = NULL;
+    timer->prev = NULL;
+    timer->expires = 0;
+    timer->on_expire = on_expire;
+}
+
+void evhttp_timer_set(timers_t *self, evhttp_timer_t *timer, double seconds)
+{
+    // round up, so it is never early
+    unsigned long ticks = (unsigned long)(seconds / self->resolution) + 1;
+
+    evhttp_timer_cancel(timer);
+    timer->expires = current_tick(self) + ticks;
+    list_push(self->slots + timer->expires % EVHTTP_TIMER_SLOTS, timer);
+}
+
+void evhttp_timer_cancel(evhttp_timer_t *timer)
+{
+    if (!timer->next)
+        return;
+
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->next = NULL;
+    timer->prev = NULL;
+}
+
+void on_tick(ev_loop_t *loop, ev_timer *watcher, int revents)
+{
+    timers_t *self = (timers_t *)watcher->data;
+    unsigned long target = current_tick(self);
+
+    // catch up on any ticks a busy loop missed
+    while (self->now < target)
+    {
+        evhttp_timer_t pending;
+        evhttp_timer_t *head;
+
+        ++self->now;
+        head = self->slots + self->now % EVHTTP_TIMER_SLOTS;
+        if (head->next == head)
+            continue;
+
+        // move the slot aside, as expiring can set or
+        // cancel other timers, including ones in it
+        pending.next = head->next;
+        pending.prev = head->prev;
+        pending.next->prev = &pending;
+        pending.prev->next = &pending;
+        list_init(head);
+
+        while (pending.next != &pending)
+        {
+            evhttp_timer_t *timer = pending.next;
+            evhttp_timer_cancel(timer);
+
+            // later laps round the wheel go back in
+            if (timer->expires > self->now)
+                list_push(head, timer);
+            else
+                timer->on_expire(timer);
+        }
+    }
+}
@@ -0,0 +1,59 @@
+#ifndef EVHTTPTIMER_H
+#define EVHTTPTIMER_H
+
+#include <ev.h>
+
+// A hashed timer wheel, one per loop, for timeouts that are set far
+// more often than they fire. Setting or cancelling a timer is O(1)
+// and one ev_timer ticks the whole wheel, so every connection can
+// push its deadline back on every read without touching the loop's
+// timer heap. Timers fire up to one tick late.
+
+#define EVHTTP_TIMER_SLOTS 256
+
+typedef struct evhttp_timer evhttp_timer_t;
+typedef struct evhttp_timers evhttp_timers_t;
+
+typedef void (*evhttp_timer_on_expire)(evhttp_timer_t *timer);
+
+void evhttp_timers_init(evhttp_timers_t *self, struct ev_loop *loop, double resolution);
+void evhttp_timers_free(evhttp_timers_t *self);
+// The timeouts for connections using the wheel, in seconds,
+// 0 for none, see evhttp_connection_use_timers. All are 0 to
+// start with.
+void evhttp_timers_set_timeouts(evhttp_timers_t *self, double header, double body, double idle, double write);
+
+void evhttp_timer_init(evhttp_timer_t *timer, evhttp_timer_on_expire on_expire);
+// Fire after seconds, replacing any earlier setting
+void evhttp_timer_set(evhttp_timers_t *self, evhttp_timer_t *timer, double seconds);
+void evhttp_timer_cancel(evhttp_timer_t *timer);
+
+// Internal structs, defined so they can be put on the stack
+
+struct evhttp_timer
+{
+    evhttp_timer_t *next;
+    evhttp_timer_t *prev;
+    unsigned long expires; // in ticks
+    evhttp_timer_on_expire on_expire;
+};
+
+struct evhttp_timers
+{
+    struct ev_loop *loop;
+    struct ev_timer tick_watcher;
+    double resolution;
+    double started;
+    unsigned long now; // in ticks
+
+    // see evhttp_timers_set_timeouts
+    double header_timeout;
+    double body_timeout;
+    double idle_timeout;
+    double write_timeout;
+
+    // list heads
+    evhttp_timer_t slots[EVHTTP_TIMER_SLOTS];
+};
+
+#endif
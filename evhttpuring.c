@@ -0,0 +1,423 @@
+#include "evhttpuring.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+typedef evhttp_uring_t uring_t;
+typedef evhttp_uring_link_t link_t;
+typedef struct ev_loop ev_loop_t;
+
+// What a completion is for, in the low bits of its user_data,
+// cancels have none and their completions are ignored
+#define OP_READ 1
+#define OP_WRITE 2
+#define OP_MASK 3
+
+static void on_ring(ev_loop_t *loop, ev_io *watcher, int revents);
+static void on_prepare(ev_loop_t *loop, ev_prepare *watcher, int revents);
+
+///
+// Rings
+///
+
+static int submit(uring_t *self)
+{
+    while (self->to_submit > 0)
+    {
+        int submitted = syscall(__NR_io_uring_enter, self->fd, self->to_submit, 0, 0, NULL, 0);
+        if (submitted < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        self->to_submit -= submitted;
+    }
+    return 0;
+}
+
+// The next free entry, cleared, the kernel only looks
+// at them when submit is called so it can be filled in
+// after being counted
+static struct io_uring_sqe *sqe_get(uring_t *self)
+{
+    unsigned tail = *self->sq_tail;
+    struct io_uring_sqe *sqe;
+
+    if (tail - __atomic_load_n(self->sq_head, __ATOMIC_ACQUIRE) > self->sq_mask)
+    {
+        // full, send what there is now
+        if (submit(self) != 0 || tail - __atomic_load_n(self->sq_head, __ATOMIC_ACQUIRE) > self->sq_mask)
+            return NULL;
+    }
+
+    sqe = (struct io_uring_sqe *)self->sqes + (tail & self->sq_mask);
+    memset(sqe, 0, sizeof(*sqe));
+    __atomic_store_n(self->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ++self->to_submit;
+    return sqe;
+}
+
+static void cancel(uring_t *self, uint64_t user_data)
+{
+    struct io_uring_sqe *sqe = sqe_get(self);
+    if (!sqe)
+        return;
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = user_data;
+}
+
+// Hand a buffer back for the kernel to read into
+static void buffer_give(uring_t *self, int id)
+{
+    struct io_uring_buf_ring *ring = (struct io_uring_buf_ring *)self->buffer_ring;
+    struct io_uring_buf *buffer = &ring->bufs[self->buffer_tail & (EVHTTP_URING_BUFFERS - 1)];
+
+    // set field by field, the first one's resv is the tail
+    buffer->addr = (uintptr_t)(self->buffers + (size_t)id * EVHTTP_URING_BUFFER_SIZE);
+    buffer->len = EVHTTP_URING_BUFFER_SIZE;
+    buffer->bid = id;
+    ++self->buffer_tail;
+    __atomic_store_n(&ring->tail, self->buffer_tail, __ATOMIC_RELEASE);
+}
+
+int evhttp_uring_init(uring_t *self, struct ev_loop *loop)
+{
+    struct io_uring_params params;
+    struct io_uring_buf_reg reg;
+    size_t sq_size, cq_size;
+    int idx, error;
+
+    memset(self, 0, sizeof(*self));
+    self->loop = loop;
+    self->multishot = 1;
+    self->ring = MAP_FAILED;
+    self->sqes = MAP_FAILED;
+    self->buffer_ring = MAP_FAILED;
+
+    memset(&params, 0, sizeof(params));
+    self->fd = syscall(__NR_io_uring_setup, EVHTTP_URING_ENTRIES, &params);
+    if (self->fd < 0)
+        return -1;
+
+    // older kernels need more mapping and can drop completions
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_NODROP))
+    {
+        errno = ENOSYS;
+        goto fail;
+    }
+
+    sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    self->ring_size = sq_size > cq_size ? sq_size : cq_size;
+    self->ring = mmap(NULL, self->ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, self->fd, IORING_OFF_SQ_RING);
+    self->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    self->sqes = mmap(NULL, self->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, self->fd, IORING_OFF_SQES);
+    if (self->ring == MAP_FAILED || self->sqes == MAP_FAILED)
+        goto fail;
+
+    self->sq_head = (unsigned *)((char *)self->ring + params.sq_off.head);
+    self->sq_tail = (unsigned *)((char *)self->ring + params.sq_off.tail);
+    self->sq_mask = *(unsigned *)((char *)self->ring + params.sq_off.ring_mask);
+    self->sq_array = (unsigned *)((char *)self->ring + params.sq_off.array);
+    self->cq_head = (unsigned *)((char *)self->ring + params.cq_off.head);
+    self->cq_tail = (unsigned *)((char *)self->ring + params.cq_off.tail);
+    self->cq_mask = *(unsigned *)((char *)self->ring + params.cq_off.ring_mask);
+    self->cqes = (char *)self->ring + params.cq_off.cqes;
+
+    // entries are always used in order
+    for (idx=0; idx<(int)params.sq_entries; ++idx)
+        self->sq_array[idx] = idx;
+
+    self->buffer_ring = mmap(NULL, EVHTTP_URING_BUFFERS * sizeof(struct io_uring_buf), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    self->buffers = (char *)malloc((size_t)EVHTTP_URING_BUFFERS * EVHTTP_URING_BUFFER_SIZE);
+    if (self->buffer_ring == MAP_FAILED || !self->buffers)
+        goto fail;
+
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uintptr_t)self->buffer_ring;
+    reg.ring_entries = EVHTTP_URING_BUFFERS;
+    reg.bgid = 0;
+    if (syscall(__NR_io_uring_register, self->fd, IORING_REGISTER_PBUF_RING, &reg, 1) != 0)
+        goto fail;
+
+    for (idx=0; idx<EVHTTP_URING_BUFFERS; ++idx)
+        buffer_give(self, idx);
+
+    // neither keeps the loop going, only the links do
+    self->ring_watcher.data = self;
+    ev_io_init(&self->ring_watcher, on_ring, self->fd, EV_READ);
+    ev_io_start(loop, &self->ring_watcher);
+    ev_unref(loop);
+
+    self->submit_watcher.data = self;
+    ev_prepare_init(&self->submit_watcher, on_prepare);
+    ev_prepare_start(loop, &self->submit_watcher);
+    ev_unref(loop);
+    return 0;
+
+fail:
+    error = errno;
+    if (self->ring != MAP_FAILED)
+        munmap(self->ring, self->ring_size);
+    if (self->sqes != MAP_FAILED)
+        munmap(self->sqes, self->sqes_size);
+    if (self->buffer_ring != MAP_FAILED)
+        munmap(self->buffer_ring, EVHTTP_URING_BUFFERS * sizeof(struct io_uring_buf));
+    free(self->buffers);
+    close(self->fd);
+    errno = error;
+    return -1;
+}
+
+void evhttp_uring_free(uring_t *self)
+{
+    // the links go once their cancels complete, or
+    // with the writes that were still to be gathered
+    on_prepare(self->loop, &self->submit_watcher, EV_PREPARE);
+    while (self->links > 0)
+    {
+        if (syscall(__NR_io_uring_enter, self->fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0 && errno != EINTR)
+            break;
+        on_ring(self->loop, &self->ring_watcher, EV_READ);
+    }
+
+    ev_ref(self->loop);
+    ev_io_stop(self->loop, &self->ring_watcher);
+    ev_ref(self->loop);
+    ev_prepare_stop(self->loop, &self->submit_watcher);
+
+    // closing the ring cancels anything left
+    munmap(self->ring, self->ring_size);
+    munmap(self->sqes, self->sqes_size);
+    close(self->fd);
+    munmap(self->buffer_ring, EVHTTP_URING_BUFFERS * sizeof(struct io_uring_buf));
+    free(self->buffers);
+}
+
+///
+// Links
+///
+
+static void link_release(link_t *link)
+{
+    if (!link->data && link->pending == 0 && link->uring->current != link)
+    {
+        --link->uring->links;
+        if (link->on_done)
+            link->on_done(link->done_data);
+        free(link);
+    }
+}
+
+static void recv_start(link_t *link)
+{
+    struct io_uring_sqe *sqe = sqe_get(link->uring);
+    if (!sqe)
+        return;
+
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = link->fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = 0;
+    sqe->user_data = (uintptr_t)link | OP_READ;
+    link->recv_active = 1;
+    ++link->pending;
+}
+
+link_t *evhttp_uring_attach(uring_t *self, int fd, evhttp_uring_on_read on_read, evhttp_uring_on_gather on_gather, evhttp_uring_on_written on_written, void *data)
+{
+    link_t *link = (link_t *)malloc(sizeof(link_t));
+    if (!link)
+        return NULL;
+
+    ++self->links;
+    link->uring = self;
+    link->fd = fd;
+    link->data = data;
+    link->on_read = on_read;
+    link->on_gather = on_gather;
+    link->on_written = on_written;
+    link->on_done = NULL;
+    link->done_data = NULL;
+    link->reading = 0;
+    link->recv_active = 0;
+    link->writing = 0;
+    link->pending = 0;
+    link->next_write = NULL;
+
+    ev_ref(self->loop);
+    evhttp_uring_read_start(link);
+    return link;
+}
+
+void evhttp_uring_detach(link_t *link, evhttp_uring_on_done on_done, void *done_data)
+{
+    uring_t *self = link->uring;
+
+    link->data = NULL;
+    link->on_done = on_done;
+    link->done_data = done_data;
+    link->reading = 0;
+    if (link->recv_active)
+        cancel(self, (uintptr_t)link | OP_READ);
+    if (link->writing == 2)
+        cancel(self, (uintptr_t)link | OP_WRITE);
+
+    // now, so the cancels go in before the caller closes the
+    // socket, a write is only known to be over once it completes
+    submit(self);
+    ev_unref(self->loop);
+    link_release(link);
+}
+
+void evhttp_uring_read_stop(link_t *link)
+{
+    link->reading = 0;
+    if (link->recv_active)
+        cancel(link->uring, (uintptr_t)link | OP_READ);
+}
+
+void evhttp_uring_read_start(link_t *link)
+{
+    link->reading = 1;
+    // a recv still being cancelled starts again when it finishes
+    if (!link->recv_active && link->uring->multishot)
+        recv_start(link);
+}
+
+void evhttp_uring_write(link_t *link)
+{
+    uring_t *self = link->uring;
+    if (!link->data || link->writing)
+        return;
+
+    link->writing = 1;
+    ++link->pending;
+    link->next_write = self->writes;
+    self->writes = link;
+}
+
+///
+// Loop
+///
+
+static void complete(uring_t *self, uint64_t user_data, int result, unsigned flags)
+{
+    link_t *link = (link_t *)(uintptr_t)(user_data & ~(uint64_t)OP_MASK);
+    if (!link)
+        return;
+
+    self->current = link;
+    if ((user_data & OP_MASK) == OP_READ)
+    {
+        char *buffer = NULL;
+        int id = -1;
+
+        if (flags & IORING_CQE_F_BUFFER)
+        {
+            id = flags >> IORING_CQE_BUFFER_SHIFT;
+            buffer = self->buffers + (size_t)id * EVHTTP_URING_BUFFER_SIZE;
+        }
+        if (!(flags & IORING_CQE_F_MORE))
+        {
+            link->recv_active = 0;
+            --link->pending;
+        }
+
+        // a kernel without multishot recv says so straight away
+        if (result == -EINVAL)
+            self->multishot = 0;
+
+        // running out of buffers, or a cancel, only
+        // means the recv has to be started again
+        if (link->data && result != -ENOBUFS && result != -ECANCELED)
+            link->on_read(link->data, buffer, result);
+
+        if (id >= 0)
+            buffer_give(self, id);
+
+        if (link->data && link->reading && !link->recv_active && self->multishot &&
+            (result > 0 || result == -ENOBUFS || result == -ECANCELED))
+            recv_start(link);
+    }
+    else
+    {
+        link->writing = 0;
+        --link->pending;
+        if (link->data)
+            link->on_written(link->data, result);
+    }
+    self->current = NULL;
+    link_release(link);
+}
+
+void on_ring(ev_loop_t *loop, ev_io *watcher, int revents)
+{
+    uring_t *self = (uring_t *)watcher->data;
+    unsigned head = *self->cq_head;
+
+    while (head != __atomic_load_n(self->cq_tail, __ATOMIC_ACQUIRE))
+    {
+        struct io_uring_cqe *cqe = (struct io_uring_cqe *)self->cqes + (head & self->cq_mask);
+        uint64_t user_data = cqe->user_data;
+        int result = cqe->res;
+        unsigned flags = cqe->flags;
+
+        // free the slot before the callback, which can
+        // queue more work
+        ++head;
+        __atomic_store_n(self->cq_head, head, __ATOMIC_RELEASE);
+        complete(self, user_data, result, flags);
+    }
+}
+
+// Gather every write asked for since the last time round, then
+// submit them along with anything else in one go
+void on_prepare(ev_loop_t *loop, ev_prepare *watcher, int revents)
+{
+    uring_t *self = (uring_t *)watcher->data;
+
+    while (self->writes)
+    {
+        link_t *link = self->writes;
+        self->writes = link->next_write;
+        link->writing = 0;
+        --link->pending;
+
+        if (!link->data)
+        {
+            link_release(link);
+            continue;
+        }
+
+        int count = link->on_gather(link->data, link->iov, EVHTTP_URING_IOV_MAX);
+        if (count == 0)
+            continue;
+
+        struct io_uring_sqe *sqe = sqe_get(self);
+        if (!sqe)
+        {
+            // try again next time round
+            evhttp_uring_write(link);
+            break;
+        }
+        sqe->opcode = IORING_OP_WRITEV;
+        sqe->fd = link->fd;
+        sqe->addr = (uintptr_t)link->iov;
+        sqe->len = count;
+        sqe->user_data = (uintptr_t)link | OP_WRITE;
+        link->writing = 2;
+        ++link->pending;
+    }
+
+    submit(self);
+}
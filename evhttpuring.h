@@ -0,0 +1,107 @@
+#ifndef EVHTTPURING_H
+#define EVHTTPURING_H
+
+#include <ev.h>
+#include <sys/uio.h>
+
+// An io_uring per loop that sockets can do their reads and writes
+// through instead of a readiness wakeup followed by a syscall each.
+// Reads are one multishot recv per socket into a ring of buffers
+// the kernel picks from, writes are writevs gathered just before
+// the loop blocks and submitted all together, and completions come
+// back through one watcher on the ring. The loop stays libev's, so
+// timers and everything else carry on as before.
+
+#define EVHTTP_URING_ENTRIES 1024 // submission queue size
+#define EVHTTP_URING_BUFFERS 256 // a power of two
+#define EVHTTP_URING_BUFFER_SIZE (16 * 1024)
+#define EVHTTP_URING_IOV_MAX 64
+
+typedef struct evhttp_uring evhttp_uring_t;
+typedef struct evhttp_uring_link evhttp_uring_link_t;
+
+// Bytes read into data, 0 at the end of the stream or -errno. The
+// buffer goes back to the kernel as soon as this returns.
+typedef void (*evhttp_uring_on_read)(void *data, char *buffer, int result);
+// Fill iov with at most max pieces to write, returns how many
+typedef int (*evhttp_uring_on_gather)(void *data, struct iovec *iov, int max);
+// Bytes written or -errno
+typedef void (*evhttp_uring_on_written)(void *data, int result);
+// A detached link has nothing left in flight
+typedef void (*evhttp_uring_on_done)(void *data);
+
+// Returns -1 with errno set if io_uring, or a part of it that is
+// needed, is not there, in which case stick with plain libev
+int evhttp_uring_init(evhttp_uring_t *self, struct ev_loop *loop);
+// Every link must be detached first, this waits for
+// what they had in flight to be cancelled
+void evhttp_uring_free(evhttp_uring_t *self);
+
+// Start reading fd, the link keeps the loop running until detached.
+// NULL if it could not be made.
+evhttp_uring_link_t *evhttp_uring_attach(evhttp_uring_t *self, int fd, evhttp_uring_on_read on_read, evhttp_uring_on_gather on_gather, evhttp_uring_on_written on_written, void *data);
+// Cancel everything in flight, no callbacks come after this but
+// on_done, if given. A write can go on until its cancel completes,
+// so what it points at must be left alone until on_done, which can
+// come before this returns.
+void evhttp_uring_detach(evhttp_uring_link_t *link, evhttp_uring_on_done on_done, void *done_data);
+void evhttp_uring_read_stop(evhttp_uring_link_t *link);
+void evhttp_uring_read_start(evhttp_uring_link_t *link);
+// Gather and write before the loop next blocks, unless already writing
+void evhttp_uring_write(evhttp_uring_link_t *link);
+
+// Internal structs, defined so evhttp_uring_t can be put on the stack
+
+struct evhttp_uring_link
+{
+    evhttp_uring_t *uring;
+    int fd;
+    void *data; // NULL once detached
+    evhttp_uring_on_read on_read;
+    evhttp_uring_on_gather on_gather;
+    evhttp_uring_on_written on_written;
+    evhttp_uring_on_done on_done;
+    void *done_data;
+
+    int reading; // wanted
+    int recv_active; // a multishot recv is in flight
+    int writing; // 0 idle, 1 waiting to be gathered, 2 in flight
+    int pending; // operations still to complete, including waiting
+    evhttp_uring_link_t *next_write;
+    struct iovec iov[EVHTTP_URING_IOV_MAX];
+};
+
+struct evhttp_uring
+{
+    struct ev_loop *loop;
+    int fd;
+    int multishot; // cleared if the kernel turns out not to have it
+
+    // the rings, shared with the kernel
+    void *ring;
+    size_t ring_size;
+    void *sqes;
+    size_t sqes_size;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned cq_mask;
+    void *cqes;
+    unsigned to_submit;
+
+    // the buffers the kernel reads into
+    void *buffer_ring;
+    unsigned short buffer_tail;
+    char *buffers;
+
+    int links; // not yet freed, detached or not
+    evhttp_uring_link_t *writes;
+    evhttp_uring_link_t *current; // the one being called back
+    struct ev_io ring_watcher;
+    struct ev_prepare submit_watcher;
+};
+
+#endif
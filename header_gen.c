@@ -0,0 +1,232 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <ctype.h>
+
+// Writes evhttpheaders.h and evhttpheaders.c, a perfect hash over the
+// header names below. The hash only looks at the length and three
+// bytes of the lowercased key, so is the same cost for any key and
+// leaves one compare to tell a known name from anything else. Run
+// with "make headers" after changing the list.
+
+static const char *names[] =
+{
+    "accept",
+    "accept-charset",
+    "accept-encoding",
+    "accept-language",
+    "accept-ranges",
+    "access-control-allow-credentials",
+    "access-control-allow-headers",
+    "access-control-allow-methods",
+    "access-control-allow-origin",
+    "access-control-expose-headers",
+    "access-control-max-age",
+    "access-control-request-headers",
+    "access-control-request-method",
+    "age",
+    "allow",
+    "alt-svc",
+    "authorization",
+    "cache-control",
+    "connection",
+    "content-disposition",
+    "content-encoding",
+    "content-language",
+    "content-length",
+    "content-location",
+    "content-range",
+    "content-security-policy",
+    "content-type",
+    "cookie",
+    "date",
+    "dnt",
+    "etag",
+    "expect",
+    "expires",
+    "forwarded",
+    "from",
+    "host",
+    "if-match",
+    "if-modified-since",
+    "if-none-match",
+    "if-range",
+    "if-unmodified-since",
+    "keep-alive",
+    "last-modified",
+    "link",
+    "location",
+    "max-forwards",
+    "origin",
+    "pragma",
+    "proxy-authenticate",
+    "proxy-authorization",
+    "range",
+    "referer",
+    "refresh",
+    "retry-after",
+    "server",
+    "set-cookie",
+    "strict-transport-security",
+    "te",
+    "trailer",
+    "transfer-encoding",
+    "upgrade",
+    "upgrade-insecure-requests",
+    "user-agent",
+    "vary",
+    "via",
+    "warning",
+    "www-authenticate",
+    "x-content-type-options",
+    "x-forwarded-for",
+    "x-forwarded-host",
+    "x-forwarded-proto",
+    "x-frame-options",
+    "x-real-ip",
+    "x-request-id",
+    "x-requested-with",
+};
+
+#define COUNT ((int)(sizeof(names) / sizeof(names[0])))
+// Slots in the table, the ids have to fit in a byte
+#define BITS 8
+
+// Must match evhttp_header_hash in the output
+static uint32_t key_of(const char *name)
+{
+    int length = strlen(name);
+    return (uint32_t)length << 24 |
+           (uint32_t)(unsigned char)name[0] << 16 |
+           (uint32_t)(unsigned char)name[length - 2] << 8 |
+           (uint32_t)(unsigned char)name[length - 1];
+}
+
+static uint32_t hash(uint32_t key, uint32_t seed)
+{
+    return (key * seed) >> (32 - BITS);
+}
+
+static void enum_name(char *out, const char *name)
+{
+    for (; *name; ++name, ++out)
+        *out = *name == '-' ? '_' : toupper((unsigned char)*name);
+    *out = 0;
+}
+
+int main(int argc, char * const argv[])
+{
+    unsigned char slots[1 << BITS];
+    uint32_t seed, state = 2463534242u;
+    int idx, other, tries, max_length = 0;
+    char id[64];
+
+    // the hashed bytes alone have to tell the names apart
+    for (idx=0; idx<COUNT; ++idx)
+    {
+        for (other=0; other<idx; ++other)
+        {
+            if (key_of(names[idx]) == key_of(names[other]))
+            {
+                fprintf(stderr, "%s and %s hash the same bytes\n", names[idx], names[other]);
+                return 1;
+            }
+        }
+        if ((int)strlen(names[idx]) > max_length)
+            max_length = strlen(names[idx]);
+    }
+
+    for (tries=0; tries<10000000; ++tries)
+    {
+        // xorshift, so the output is the same every run
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        seed = state | 1;
+
+        memset(slots, 0, sizeof(slots));
+        for (idx=0; idx<COUNT; ++idx)
+        {
+            uint32_t slot = hash(key_of(names[idx]), seed);
+            if (slots[slot])
+                break;
+            slots[slot] = idx + 1;
+        }
+        if (idx == COUNT)
+            break;
+    }
+    if (idx != COUNT)
+    {
+        fprintf(stderr, "no seed found\n");
+        return 1;
+    }
+
+    FILE *h = fopen("evhttpheaders.h", "w");
+    FILE *c = fopen("evhttpheaders.c", "w");
+    if (!h || !c)
+    {
+        perror("header_gen");
+        return 1;
+    }
+
+    fprintf(h, "// Generated by header_gen, do not edit\n\n");
+    fprintf(h, "#ifndef EVHTTPHEADERS_H\n#define EVHTTPHEADERS_H\n\n");
+    fprintf(h, "#include <string.h>\n\n");
+    fprintf(h, "// The header names known to the parser, for on_header_id\n\n");
+    fprintf(h, "typedef enum\n{\n    EVHTTP_HEADER_OTHER = 0,\n");
+    for (idx=0; idx<COUNT; ++idx)
+    {
+        enum_name(id, names[idx]);
+        fprintf(h, "    EVHTTP_HEADER_%s,\n", id);
+    }
+    fprintf(h, "    EVHTTP_HEADER_COUNT\n} evhttp_header_id_t;\n\n");
+
+    fprintf(h, "// Lowercase names by id\n");
+    fprintf(h, "extern const char *const evhttp_header_names[EVHTTP_HEADER_COUNT];\n");
+    fprintf(h, "extern const unsigned char evhttp_header_lengths[EVHTTP_HEADER_COUNT];\n");
+    fprintf(h, "extern const unsigned char evhttp_header_slots[%i];\n\n", 1 << BITS);
+
+    fprintf(h, "#define EVHTTP_HEADER_MAX_LENGTH %i\n\n", max_length);
+
+    fprintf(h, "static inline unsigned evhttp_header_hash(const char *key, int length)\n{\n");
+    fprintf(h, "    unsigned key_bytes = (unsigned)length << 24 |\n");
+    fprintf(h, "                         (unsigned)(unsigned char)key[0] << 16 |\n");
+    fprintf(h, "                         (unsigned)(unsigned char)key[length - 2] << 8 |\n");
+    fprintf(h, "                         (unsigned)(unsigned char)key[length - 1];\n");
+    fprintf(h, "    return (key_bytes * %uu) >> %i;\n}\n\n", seed, 32 - BITS);
+
+    fprintf(h, "// The id of a lowercase key, EVHTTP_HEADER_OTHER if it is not known\n");
+    fprintf(h, "static inline evhttp_header_id_t evhttp_header_id(const char *key, int length)\n{\n");
+    fprintf(h, "    int id;\n");
+    fprintf(h, "    if (length < 2 || length > EVHTTP_HEADER_MAX_LENGTH)\n");
+    fprintf(h, "        return EVHTTP_HEADER_OTHER;\n");
+    fprintf(h, "    id = evhttp_header_slots[evhttp_header_hash(key, length)];\n");
+    fprintf(h, "    if (evhttp_header_lengths[id] != length || memcmp(evhttp_header_names[id], key, length))\n");
+    fprintf(h, "        return EVHTTP_HEADER_OTHER;\n");
+    fprintf(h, "    return (evhttp_header_id_t)id;\n}\n\n");
+    fprintf(h, "#endif\n");
+
+    fprintf(c, "// Generated by header_gen, do not edit\n\n");
+    fprintf(c, "#include \"evhttpheaders.h\"\n\n");
+    fprintf(c, "const char *const evhttp_header_names[EVHTTP_HEADER_COUNT] =\n{\n    \"\",\n");
+    for (idx=0; idx<COUNT; ++idx)
+        fprintf(c, "    \"%s\",\n", names[idx]);
+    fprintf(c, "};\n\n");
+
+    // other has length 0 so never matches
+    fprintf(c, "const unsigned char evhttp_header_lengths[EVHTTP_HEADER_COUNT] =\n{\n    0,");
+    for (idx=0; idx<COUNT; ++idx)
+        fprintf(c, "%s%i,", idx % 16 == 15 ? "\n    " : " ", (int)strlen(names[idx]));
+    fprintf(c, "\n};\n\n");
+
+    fprintf(c, "const unsigned char evhttp_header_slots[%i] =\n{\n", 1 << BITS);
+    for (idx=0; idx<(1 << BITS); ++idx)
+        fprintf(c, "%s%i,%s", idx % 16 == 0 ? "    " : " ", slots[idx], idx % 16 == 15 ? "\n" : "");
+    fprintf(c, "};\n");
+
+    fclose(h);
+    fclose(c);
+    printf("%i names, seed %u after %i tries\n", COUNT, seed, tries + 1);
+    return 0;
+}
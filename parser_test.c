@@ -0,0 +1,303 @@
+#include "evhttpconn.h"
+#include "evhttppool.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+// Writes canned streams into a connection over a socketpair, split
+// at every offset and then one byte at a time, and checks that the
+// callbacks come out the same as when the stream arrives in one go
+
+typedef struct
+{
+    const char *name;
+    const char *stream; // ends with the writer closing
+    int messages; // completed, with a malformed one ending the stream
+} corpus_t;
+
+static const corpus_t corpus[] =
+{
+    {
+        "keep-alive",
+        "GET /index.html HTTP/1.1\r\n"
+        "Host: www.example.com\r\n"
+        "Cookie: session=0123456789abcdef0123456789abcdef; prefs=theme%3Ddark%26lang%3Den\r\n"
+        "Accept: */*\r\n"
+        "\r\n"
+        "POST /form HTTP/1.1\r\n"
+        "Host: www.example.com\r\n"
+        "Content-Length: 11\r\n"
+        "\r\n"
+        "hello world"
+        "\r\n"
+        "GET /last HTTP/1.1\r\n"
+        "Host: www.example.com\r\n"
+        "Connection: close\r\n"
+        "\r\n",
+        3,
+    },
+    {
+        "chunked",
+        "HTTP/1.1 200 OK\r\n"
+        "Content-Type: text/html\r\n"
+        "Transfer-Encoding: chunked\r\n"
+        "\r\n"
+        "18\r\n"
+        "<html><body><p>one two\r\n\r\n"
+        "10;name=value\r\n"
+        "three four</p>\r\n\r\n"
+        "e\r\n"
+        "</body></html>\r\n"
+        "0\r\n"
+        "Trailer: value\r\n"
+        "\r\n"
+        "HTTP/1.1 200 OK\r\n"
+        "Content-Length: 5\r\n"
+        "\r\n"
+        "after",
+        2,
+    },
+    {
+        "eof",
+        "HTTP/1.0 200 OK\r\n"
+        "Server: test\r\n"
+        "Content-Type: text/plain\r\n"
+        "\r\n"
+        "a body with no length\r\n"
+        "that runs until the close",
+        1,
+    },
+    {
+        "lengths",
+        "POST /same HTTP/1.1\r\n"
+        "Content-Length: 5\r\n"
+        "Content-Length: 5\r\n"
+        "\r\n"
+        "hello"
+        "POST /differ HTTP/1.1\r\n"
+        "Content-Length: 5\r\n"
+        "Content-Length: 6\r\n"
+        "\r\n"
+        "hello!",
+        1,
+    },
+    {
+        "length+chunk",
+        "HTTP/1.1 200 OK\r\n"
+        "Content-Length: 3\r\n"
+        "Transfer-Encoding: chunked\r\n"
+        "\r\n"
+        "3\r\n"
+        "abc\r\n"
+        "0\r\n"
+        "\r\n",
+        0,
+    },
+    {
+        "chunk+length",
+        "POST /upload HTTP/1.1\r\n"
+        "Transfer-Encoding: chunked\r\n"
+        "Content-Length: 3\r\n"
+        "\r\n"
+        "3\r\n"
+        "abc\r\n"
+        "0\r\n"
+        "\r\n",
+        0,
+    },
+};
+
+#define CORPUS ((int)(sizeof(corpus) / sizeof(corpus[0])))
+
+// Everything the callbacks see, in order, with the pieces of a body
+// joined up as where on_chunk splits them depends on the reads
+typedef struct
+{
+    char data[16384];
+    int length;
+    int in_body;
+    int messages;
+    int closed;
+} transcript_t;
+
+static void record(transcript_t *self, const char *tag, const char *data, int length)
+{
+    int size = strlen(tag);
+    if (self->length + size + length + 1 > (int)sizeof(self->data))
+    {
+        fprintf(stderr, "transcript too long\n");
+        exit(1);
+    }
+    if (self->in_body && !strcmp(tag, "chunk "))
+    {
+        // carry on the last line
+        --self->length;
+        size = 0;
+    }
+    self->in_body = !strcmp(tag, "chunk ");
+
+    memcpy(self->data + self->length, tag, size);
+    memcpy(self->data + self->length + size, data, length);
+    self->length += size + length;
+    self->data[self->length++] = '\n';
+}
+
+static void on_first_line(evhttp_string_t first, evhttp_string_t second, evhttp_string_t third, void *data)
+{
+    record((transcript_t *)data, "first ", first.data, first.length);
+    record((transcript_t *)data, "second ", second.data, second.length);
+    record((transcript_t *)data, "third ", third.data, third.length);
+}
+
+static void on_header(evhttp_string_t key, evhttp_string_t value, void *data)
+{
+    record((transcript_t *)data, "key ", key.data, key.length);
+    record((transcript_t *)data, "value ", value.data, value.length);
+}
+
+static void on_headers_end(evhttp_string_t message, void *data)
+{
+    record((transcript_t *)data, "head ", message.data, message.length);
+}
+
+static void on_chunk(evhttp_string_t content, void *data)
+{
+    record((transcript_t *)data, "chunk ", content.data, content.length);
+}
+
+static void on_complete_content(evhttp_string_t content, void *data)
+{
+    record((transcript_t *)data, "content ", content.data, content.length);
+}
+
+static void on_complete(void *data)
+{
+    record((transcript_t *)data, "complete", "", 0);
+    ++((transcript_t *)data)->messages;
+}
+
+static void on_close(void *data)
+{
+    ((transcript_t *)data)->closed = 1;
+}
+
+// Write the stream in the pieces that end at each of splits, letting
+// the connection read each one before the next goes in
+static void run(struct ev_loop *loop, evhttp_pool_t *pool, int whole, const char *stream, int size,
+               const int *splits, int count, transcript_t *result)
+{
+    evhttp_connection_t conn;
+    int fds[2];
+    int idx, offset = 0;
+
+    result->length = 0;
+    result->in_body = 0;
+    result->messages = 0;
+    result->closed = 0;
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+    {
+        perror("socketpair");
+        exit(1);
+    }
+
+    evhttp_connection_init_with_pool(&conn, loop, pool, fds[0],
+                                     on_first_line,
+                                     on_header,
+                                     on_headers_end,
+                                     whole ? NULL : on_chunk,
+                                     whole ? on_complete_content : NULL,
+                                     on_complete,
+                                     on_close,
+                                     result);
+
+    for (idx=0; idx<=count && !result->closed; ++idx)
+    {
+        int end = idx < count ? splits[idx] : size;
+        if (write(fds[1], stream + offset, end - offset) != end - offset)
+        {
+            perror("write");
+            exit(1);
+        }
+        offset = end;
+        ev_run(loop, EVRUN_ONCE);
+    }
+
+    close(fds[1]);
+    while (!result->closed)
+        ev_run(loop, EVRUN_ONCE);
+    close(fds[0]);
+}
+
+static int check(const char *name, const char *how, const transcript_t *expected, const transcript_t *result)
+{
+    if (result->length == expected->length && !memcmp(result->data, expected->data, expected->length))
+        return 0;
+    printf("%-12s %s: callbacks differ\n", name, how);
+    return 1;
+}
+
+int main(int argc, char * const argv[])
+{
+    struct ev_loop *loop = ev_loop_new(0);
+    evhttp_pool_t pool;
+    static transcript_t expected, result;
+    static int splits[4096];
+    int i, pooled, whole, split;
+    int failed = 0, differ;
+
+    evhttp_pool_init(&pool);
+
+    for (i=0; i<CORPUS; ++i)
+    {
+        int size = strlen(corpus[i].stream);
+        if (size > (int)(sizeof(splits) / sizeof(splits[0])))
+        {
+            fprintf(stderr, "%s is too long\n", corpus[i].name);
+            return 1;
+        }
+
+        differ = 0;
+        for (pooled=0; pooled<2; ++pooled)
+        {
+            for (whole=0; whole<2; ++whole)
+            {
+                evhttp_pool_t *use = pooled ? &pool : NULL;
+                char how[64];
+
+                run(loop, use, whole, corpus[i].stream, size, NULL, 0, &expected);
+                if (expected.messages != corpus[i].messages)
+                {
+                    printf("%-12s %s%s: %i message(s) not %i\n", corpus[i].name, pooled ? "pooled, " : "",
+                           whole ? "whole" : "chunks", expected.messages, corpus[i].messages);
+                    differ = 1;
+                }
+
+                for (split=1; split<size; ++split)
+                {
+                    run(loop, use, whole, corpus[i].stream, size, &split, 1, &result);
+                    snprintf(how, sizeof(how), "%s%s, split at %i",
+                             pooled ? "pooled, " : "", whole ? "whole" : "chunks", split);
+                    differ |= check(corpus[i].name, how, &expected, &result);
+                }
+
+                for (split=1; split<size; ++split)
+                    splits[split - 1] = split;
+                run(loop, use, whole, corpus[i].stream, size, splits, size - 1, &result);
+                snprintf(how, sizeof(how), "%s%s, a byte at a time",
+                         pooled ? "pooled, " : "", whole ? "whole" : "chunks");
+                differ |= check(corpus[i].name, how, &expected, &result);
+            }
+        }
+
+        printf("%-12s %s\n", corpus[i].name, differ ? "FAILED" : "ok");
+        failed |= differ;
+    }
+
+    evhttp_pool_free(&pool);
+    ev_loop_destroy(loop);
+    return failed;
+}
@@ -0,0 +1,174 @@
+#include "evhttpscan.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Times the header scanning kernels against each other on
+// some typical header blocks, the way the parser uses them
+
+typedef struct
+{
+    const char *name;
+    const char *headers;
+} header_set_t;
+
+static const header_set_t header_sets[] =
+{
+    {
+        "browser request",
+        "Host: www.example.com\r\n"
+        "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/120.0.0.0 Safari/537.36\r\n"
+        "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,*/*;q=0.8\r\n"
+        "Accept-Language: en-GB,en;q=0.9\r\n"
+        "Accept-Encoding: gzip, deflate, br\r\n"
+        "Referer: https://www.example.com/some/where/else?page=2\r\n"
+        "Connection: keep-alive\r\n"
+        "Upgrade-Insecure-Requests: 1\r\n"
+        "Sec-Fetch-Dest: document\r\n"
+        "Sec-Fetch-Mode: navigate\r\n"
+        "Sec-Fetch-Site: same-origin\r\n"
+        "Sec-Fetch-User: ?1\r\n"
+        "Sec-CH-UA: \"Not_A Brand\";v=\"8\", \"Chromium\";v=\"120\"\r\n"
+        "Sec-CH-UA-Mobile: ?0\r\n"
+        "Sec-CH-UA-Platform: \"Linux\"\r\n"
+        "Cache-Control: max-age=0\r\n"
+        "If-None-Match: \"5e1f3a-9c2-60b1b1c4\"\r\n"
+        "If-Modified-Since: Tue, 14 Nov 2023 09:12:44 GMT\r\n"
+        "\r\n"
+    },
+    {
+        "api response",
+        "Server: nginx\r\n"
+        "Date: Tue, 14 Nov 2023 09:12:44 GMT\r\n"
+        "Content-Type: application/json\r\n"
+        "Content-Length: 1234\r\n"
+        "Connection: keep-alive\r\n"
+        "Cache-Control: no-cache\r\n"
+        "X-Request-Id: 8d7c1f1e-2b8a-4f0e-9a53-1c2d3e4f5a6b\r\n"
+        "Vary: Accept-Encoding\r\n"
+        "\r\n"
+    },
+    {
+        "big cookie",
+        "Host: www.example.com\r\n"
+        "Cookie: session=0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef; "
+        "prefs=theme%3Ddark%26lang%3Den%26tz%3DEurope%2FLondon%26layout%3Dcompact; "
+        "_ga=GA1.2.1234567890.1234567890; _gid=GA1.2.0987654321.0987654321; "
+        "tracking=aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa; "
+        "csrftoken=ZYXWVUTSRQPONMLKJIHGFEDCBAzyxwvutsrqponmlkjihgfedcba0123456789\r\n"
+        "Accept: */*\r\n"
+        "\r\n"
+    },
+};
+
+// keeps the results live
+static volatile long sink;
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Scan a header block as the parser does, returning a
+// checksum of the offsets found
+static long scan(const evhttp_scanner_t *scanner, char *data, int size)
+{
+    long sum = 0;
+    int start = 0;
+    for (;;)
+    {
+        int newline = scanner->find_chr(data, start, size, '\n');
+        if (newline < 0)
+            break;
+
+        int end = newline;
+        if (end > start && data[end-1] == '\r')
+            --end;
+        if (end == start)
+            break;
+
+        int key_start = scanner->skip_space(data, start, end);
+        int key_end = scanner->find_key_end(data, key_start, end);
+        int idx = data[key_end] == ':' ? key_end : scanner->find_chr(data, key_end, end, ':');
+        idx = idx < 0 ? end : idx + 1;
+        int value_start = scanner->skip_space(data, idx, end);
+
+        sum += key_start + key_end * 3 + value_start * 7 + newline * 11;
+        start = newline + 1;
+    }
+    return sum;
+}
+
+int main(int argc, char * const argv[])
+{
+    const evhttp_scanner_t *scanners[3];
+    int count = 0, i, j, k;
+    int iterations = argc > 1 ? atoi(argv[1]) : 1000000;
+
+    scanners[count++] = &evhttp_scanner_scalar;
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("sse2"))
+        scanners[count++] = &evhttp_scanner_sse2;
+    if (__builtin_cpu_supports("avx2"))
+        scanners[count++] = &evhttp_scanner_avx2;
+#endif
+
+    printf("%i iterations, selected scanner is %s\n\n", iterations, evhttp_scanner->name);
+
+    for (i=0; i<(int)(sizeof(header_sets)/sizeof(header_sets[0])); ++i)
+    {
+        const char *headers = header_sets[i].headers;
+        int size = strlen(headers);
+        char *data = malloc(size);
+        char *expected = malloc(size);
+        long expected_sum = 0;
+        double scalar_time = 0;
+
+        printf("%s, %i bytes\n", header_sets[i].name, size);
+
+        for (j=0; j<count; ++j)
+        {
+            // check every kernel agrees with the scalar one
+            memcpy(data, headers, size);
+            long sum = scan(scanners[j], data, size);
+            if (j == 0)
+            {
+                expected_sum = sum;
+                memcpy(expected, data, size);
+            }
+            else if (sum != expected_sum || memcmp(data, expected, size))
+            {
+                printf("  %s disagrees with scalar\n", scanners[j]->name);
+                return 1;
+            }
+
+            // the copy restores the upper case keys each time round
+            double started = now();
+            for (k=0; k<iterations; ++k)
+            {
+                memcpy(data, headers, size);
+                sum += scan(scanners[j], data, size);
+            }
+            double taken = now() - started;
+            if (j == 0)
+                scalar_time = taken;
+
+            sink = sum;
+            printf("  %-8s %8.1f ns/block %8.1f MB/s %6.2fx\n",
+                   scanners[j]->name,
+                   1e9 * taken / iterations,
+                   (double)size * iterations / taken / 1e6,
+                   scalar_time / taken);
+        }
+
+        free(expected);
+        free(data);
+        printf("\n");
+    }
+
+    return 0;
+}
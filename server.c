@@ -0,0 +1,133 @@
+#include "evhttpserver.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <signal.h>
+
+// The other side of benchmark, answers every request with the
+// same body from as many threads as asked for until interrupted
+
+static void usage()
+{
+    printf("usage: server [-p port] [-t threads] [-c connections per thread] [-s body size] [-T timeout] [-u] [-a]\n");
+}
+
+static char *body;
+static int body_length = 1000;
+
+static void on_complete(void *data)
+{
+    evhttp_server_connection_t *conn = (evhttp_server_connection_t *)data;
+    evhttp_connection_t *http_conn = &conn->http_conn;
+    int keep_alive = evhttp_connection_keep_alive(http_conn);
+
+    // the head is formatted in place, the body is the same
+    // for everyone so is sent without copying
+    char *head = evhttp_connection_make_send_buffer(http_conn, 128);
+    if (!head)
+    {
+        evhttp_connection_close(http_conn);
+        return;
+    }
+
+    int length = snprintf(head,
+                          128,
+                          "HTTP/1.1 200 OK\r\n"
+                          "Content-Length: %i\r\n"
+                          "%s"
+                          "\r\n",
+                          body_length,
+                          keep_alive ? "" : "Connection: close\r\n");
+    evhttp_connection_commit_send_buffer(http_conn, length);
+
+    evhttp_string_t content;
+    content.data = body;
+    content.length = body_length;
+    evhttp_connection_send_ref(http_conn, content, NULL, NULL);
+
+    if (!keep_alive)
+        evhttp_connection_terminate(http_conn);
+}
+
+int main(int argc, char * const argv[])
+{
+    evhttp_server_config_t config;
+    evhttp_server_t server;
+    sigset_t signals;
+    int c, i, received;
+
+    memset(&config, 0, sizeof(config));
+    config.port = 8080;
+    config.threads = 1;
+    config.max_connections = 10000;
+    config.on_complete = on_complete;
+
+    while ((c = getopt(argc, argv, "p:t:c:s:T:ua")) != -1)
+    {
+        switch (c)
+        {
+        case 'p':
+            config.port = atoi(optarg);
+            break;
+        case 't':
+            config.threads = atoi(optarg);
+            break;
+        case 'c':
+            config.max_connections = atoi(optarg);
+            break;
+        case 's':
+            body_length = atoi(optarg);
+            break;
+        case 'T':
+            // the same for every stage of a connection
+            config.header_timeout = atof(optarg);
+            config.body_timeout = config.header_timeout;
+            config.idle_timeout = config.header_timeout;
+            config.write_timeout = config.header_timeout;
+            break;
+        case 'u':
+            config.use_uring = 1;
+            break;
+        case 'a':
+            config.pin_threads = 1;
+            break;
+        default:
+            usage();
+            return 1;
+        }
+    }
+
+    body = malloc(body_length);
+    memset(body, 'x', body_length);
+
+    // the threads inherit the mask so only this one
+    // sees the signals
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    if (evhttp_server_start(&server, &config) != 0)
+    {
+        perror("server");
+        return 1;
+    }
+
+    printf("Listening on port %i with %i thread(s)\n", server.config.port, server.config.threads);
+    if (config.use_uring && !server.threads[0].has_uring)
+        printf("io_uring is not available, using plain libev\n");
+    sigwait(&signals, &received);
+
+    long accepted = 0;
+    for (i=0; i<server.config.threads; ++i)
+        accepted += server.threads[i].accepted;
+
+    evhttp_server_stop(&server);
+    printf("%li connection(s) accepted\n", accepted);
+
+    free(body);
+    return 0;
+}
@@ -0,0 +1,81 @@
+#include "evhttptimer.h"
+
+#include <stdio.h>
+#include <unistd.h>
+
+// Checks the wheel against the loop's clock
+
+#define RESOLUTION 0.01
+
+typedef struct
+{
+    evhttp_timer_t timer;
+    ev_tstamp fired;
+} probe_t;
+
+static void on_expire(evhttp_timer_t *timer)
+{
+    ((probe_t *)timer)->fired = ev_time();
+}
+
+static void on_stuck(struct ev_loop *loop, ev_timer *watcher, int revents)
+{
+}
+
+// Arm a timer after the loop has sat idle, with nothing to tick
+// the wheel, and check it does not fire early
+static int test_idle_gap(struct ev_loop *loop)
+{
+    evhttp_timers_t timers;
+    probe_t probe;
+    ev_timer stuck_watcher;
+    ev_tstamp set;
+    int failed = 0;
+
+    evhttp_timers_init(&timers, loop, RESOLUTION);
+    evhttp_timer_init(&probe.timer, on_expire);
+    probe.fired = 0;
+
+    usleep(300000);
+    ev_now_update(loop);
+    set = ev_time();
+    evhttp_timer_set(&timers, &probe.timer, 0.1);
+
+    ev_timer_init(&stuck_watcher, on_stuck, 1., 0.);
+    ev_timer_start(loop, &stuck_watcher);
+    while (!probe.fired && ev_is_active(&stuck_watcher))
+        ev_run(loop, EVRUN_ONCE);
+    ev_timer_stop(loop, &stuck_watcher);
+
+    if (!probe.fired)
+    {
+        printf("%-12s never fired\n", "idle gap");
+        failed = 1;
+    }
+    else if (probe.fired - set < 0.1)
+    {
+        printf("%-12s fired after %.3fs not 0.1s\n", "idle gap", probe.fired - set);
+        failed = 1;
+    }
+    else if (probe.fired - set > 0.1 + 2 * RESOLUTION + 0.05)
+    {
+        printf("%-12s fired late after %.3fs\n", "idle gap", probe.fired - set);
+        failed = 1;
+    }
+
+    evhttp_timers_free(&timers);
+    return failed;
+}
+
+int main(int argc, char * const argv[])
+{
+    struct ev_loop *loop = ev_loop_new(0);
+    int failed = 0, differ;
+
+    differ = test_idle_gap(loop);
+    printf("%-12s %s\n", "idle gap", differ ? "FAILED" : "ok");
+    failed |= differ;
+
+    ev_loop_destroy(loop);
+    return failed;
+}